@@ -0,0 +1,209 @@
+#ifndef PARSER_ARENA_HPP
+#define PARSER_ARENA_HPP
+// vim: set cino=; set sw=4; set ts=4
+//bump allocation for parses: an arena hands out memory from large chunks
+//and releases it all at once with reset(), which keeps the largest chunk
+//so that the next parse of a similar input does not call malloc.
+//Semantic values are best made in an arena of their own:
+//
+//  parser::arena nodes;
+//  parser::default_parser::table_context<node*, parser::arena_stack_types> context(table);
+//  ... callbacks return nodes.create<node>(...) ...
+//  nodes.reset();
+//
+//Destructors of objects made with create are not run. arena_stack_types
+//puts the stacks of a context on arena::local(), the calling thread's
+//arena. An arena counts the allocations not given back with deallocate
+//(objects made with create never are) and resets itself when that count
+//drops to zero, so once the contexts on arena::local() are destroyed the
+//next ones reuse their memory. arena::local() must not be reset by hand
+//while such a context is alive.
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+#include "parser.hpp"
+
+namespace parser {
+    class arena
+    {
+        struct chunk
+        {
+            chunk* next;
+            size_t size;
+        };
+        enum { FIRST_CHUNK_SIZE = 64 * 1024 };
+
+        chunk* chunks;
+        char* top;
+        char* limit;
+        void* last;//the most recent allocation, it can be given back or grown
+        size_t live;//allocations not given back
+
+        arena(const arena&);
+        arena& operator=(const arena&);
+
+        static char* data(chunk* c)
+        {
+            return reinterpret_cast<char*>(c) + sizeof(chunk);
+        }
+        static char* align(char* p, size_t alignment)
+        {
+            size_t misalignment = reinterpret_cast<size_t>(p) % alignment;
+            return misalignment ? p + alignment - misalignment : p;
+        }
+        void add_chunk(size_t at_least)
+        {
+            size_t size = chunks ? chunks->size * 2 : size_t(FIRST_CHUNK_SIZE);
+            while (size < at_least + sizeof(chunk))
+                size *= 2;
+            chunk* fresh = static_cast<chunk*>(std::malloc(size));
+            if (!fresh)
+                throw std::bad_alloc();
+            fresh->next = chunks;
+            fresh->size = size;
+            chunks = fresh;
+            top = data(fresh);
+            limit = reinterpret_cast<char*>(fresh) + size;
+        }
+    public:
+        arena()
+            :chunks(0), top(0), limit(0), last(0), live(0)
+        {}
+        ~arena()
+        {
+            while (chunks) {
+                chunk* next = chunks->next;
+                std::free(chunks);
+                chunks = next;
+            }
+        }
+        void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+        {
+            char* start = top ? align(top, alignment) : 0;
+            if (!start || bytes > size_t(limit - start)) {
+                add_chunk(bytes + alignment);
+                start = align(top, alignment);
+            }
+            top = start + bytes;
+            last = start;
+            ++live;
+            return start;
+        }
+        //only the most recent allocation is really given back, until the
+        //last one is and everything is
+        void deallocate(void* p, size_t)
+        {
+            if (!p)
+                return;
+            if (!--live) {
+                reset();
+            } else if (p == last) {
+                top = static_cast<char*>(p);
+                last = 0;
+            }
+        }
+        template <typename T, typename... ARGS>
+            T* create(ARGS&&... args)
+            {
+                return new (allocate(sizeof(T), alignof(T))) T(std::forward<ARGS>(args)...);
+            }
+        //frees everything but the largest chunk, which is kept for reuse
+        void reset()
+        {
+            if (!chunks)
+                return;
+            chunk* rest = chunks->next;//chunks grow, so the first is the largest
+            chunks->next = 0;
+            while (rest) {
+                chunk* next = rest->next;
+                std::free(rest);
+                rest = next;
+            }
+            top = data(chunks);
+            last = 0;
+            live = 0;
+        }
+        size_t capacity() const
+        {
+            size_t total = 0;
+            for (chunk* c = chunks; c; c = c->next)
+                total += c->size;
+            return total;
+        }
+        //the arena of the calling thread, used by default constructed
+        //arena_allocators
+        static arena& local()
+        {
+            static thread_local arena instance;
+            return instance;
+        }
+    };
+
+    template <typename T>
+        struct arena_allocator
+        {
+            typedef T value_type;
+
+            arena* source;
+
+            arena_allocator()
+                :source(&arena::local())
+            {}
+            arena_allocator(arena& source)
+                :source(&source)
+            {}
+            template <typename U>
+                arena_allocator(const arena_allocator<U>& other)
+                :source(other.source)
+                {}
+            //a copied container goes on the arena of the thread copying it
+            arena_allocator select_on_container_copy_construction() const
+            {
+                return arena_allocator();
+            }
+            T* allocate(size_t n)
+            {
+                return static_cast<T*>(source->allocate(n * sizeof(T), alignof(T)));
+            }
+            void deallocate(T* p, size_t n)
+            {
+                source->deallocate(p, n * sizeof(T));
+            }
+            template <typename U>
+                bool operator==(const arena_allocator<U>& other) const
+                {
+                    return source == other.source;
+                }
+            template <typename U>
+                bool operator!=(const arena_allocator<U>& other) const
+                {
+                    return source != other.source;
+                }
+        };
+
+    //a STACK_TYPES policy for the contexts: vectors on the thread's arena
+    struct arena_stack_types
+    {
+        typedef default_parser_params::uint uint;
+        template <typename T>
+            struct types
+            {
+                typedef std::vector<T, arena_allocator<T> > vector;
+                struct indexed_stack : vector
+                {
+                    void pop(uint n = 1)
+                    {
+                        this->erase(this->end() - n, this->end());
+                    }
+                    size_t size() const
+                    {
+                        return vector::size();
+                    }
+                };
+            };
+    };
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef PARSER_BATCH_HPP
+#define PARSER_BATCH_HPP
+// vim: set cino=; set sw=4; set ts=4
+//parsing many small independent inputs on a pool of threads:
+//
+//  parser::default_parser::table_context<token> prototype(table);
+//  std::vector<size_t> errors;
+//  parser::parse_batch(prototype, documents.begin(), documents.end(), errors, callback, on_result);
+//  ... errors[i] is the position of the first token of documents[i] with no action, or parser::batch_no_error ...
+//
+//Every input is a container of tokens, which are moved out of it. Each
+//worker copies the prototype context once and resets it between inputs,
+//so the contexts share the automaton, keep their stack storage and cost
+//nothing to set up per input. The copy is made on the worker's thread,
+//so stacks on arena::local() use that thread's arena. Workers take inputs a run at a time from a
+//shared counter. After each input, on_result(index, context, error) runs
+//on the worker that parsed it, while the context still holds the values;
+//each worker has its own copy of callback and on_result. An exception
+//thrown by either stops the batch and is rethrown by parse_batch.
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "parser.hpp"
+
+namespace parser {
+    static const size_t batch_no_error = size_t(-1);
+
+    struct ignore_batch_result
+    {
+        template <typename CONTEXT>
+            void operator()(size_t /*index*/, CONTEXT& /*context*/, size_t /*error*/)
+            {
+            }
+    };
+
+    template <typename CONTEXT, typename INPUT_ITERATOR, typename REDUCE_CALLBACK, typename RESULT_CALLBACK>
+        struct batch_worker
+        {
+            enum { RUN = 64 };
+
+            const CONTEXT* prototype;
+            INPUT_ITERATOR inputs;
+            size_t input_count;
+            std::vector<size_t>* errors;
+            REDUCE_CALLBACK callback;
+            RESULT_CALLBACK on_result;
+            std::atomic<size_t>* next;
+            std::mutex* failure_mutex;
+            std::exception_ptr* failure;
+
+            void operator()()
+            {
+                try {
+                    CONTEXT context(*prototype);
+                    for (;;) {
+                        size_t first = next->fetch_add(RUN, std::memory_order_relaxed);
+                        if (first >= input_count)
+                            return;
+                        size_t last = std::min<size_t>(input_count, first + RUN);
+                        for (size_t i = first; i < last; ++i)
+                            parse(context, i);
+                    }
+                } catch (...) {
+                    next->store(input_count, std::memory_order_relaxed);
+                    std::lock_guard<std::mutex> lock(*failure_mutex);
+                    if (!*failure)
+                        *failure = std::current_exception();
+                }
+            }
+            void parse(CONTEXT& context, size_t index)
+            {
+                context.reset();
+                INPUT_ITERATOR input = inputs + index;
+                size_t error = context.feed_symbols(input->begin(), input->end(), callback) - input->begin();
+                if (error == size_t(input->end() - input->begin()))
+                    error = batch_no_error;
+                (*errors)[index] = error;
+                on_result(index, context, error);
+            }
+        };
+
+    //parses every input of [begin, end) on thread_count threads (0 for
+    //one per core) and stores where each failed, or batch_no_error, in
+    //errors
+    template <typename CONTEXT, typename INPUT_ITERATOR, typename REDUCE_CALLBACK, typename RESULT_CALLBACK>
+        void parse_batch(const CONTEXT& prototype, INPUT_ITERATOR begin, INPUT_ITERATOR end, std::vector<size_t>& errors,
+                REDUCE_CALLBACK callback, RESULT_CALLBACK on_result, unsigned int thread_count = 0)
+        {
+            typedef batch_worker<CONTEXT, INPUT_ITERATOR, REDUCE_CALLBACK, RESULT_CALLBACK> worker_type;
+            size_t input_count = end - begin;
+            errors.assign(input_count, batch_no_error);
+            if (!thread_count)
+                thread_count = std::max(1u, std::thread::hardware_concurrency());
+            thread_count = std::min<size_t>(thread_count, (input_count + worker_type::RUN - 1) / worker_type::RUN);
+            std::atomic<size_t> next(0);
+            std::mutex failure_mutex;
+            std::exception_ptr failure;
+            worker_type prototype_worker = {&prototype, begin, input_count, &errors, callback, on_result, &next,
+                &failure_mutex, &failure};
+            //the calling thread is the last worker
+            std::vector<worker_type> workers(thread_count > 1 ? thread_count - 1 : 0, prototype_worker);
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < workers.size(); ++i)
+                threads.push_back(std::thread(std::ref(workers[i])));
+            prototype_worker();
+            for (size_t i = 0; i < threads.size(); ++i)
+                threads[i].join();
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+    template <typename CONTEXT, typename INPUT_ITERATOR, typename REDUCE_CALLBACK>
+        void parse_batch(const CONTEXT& prototype, INPUT_ITERATOR begin, INPUT_ITERATOR end, std::vector<size_t>& errors,
+                REDUCE_CALLBACK callback)
+        {
+            parse_batch(prototype, begin, end, errors, callback, ignore_batch_result());
+        }
+    template <typename CONTEXT, typename INPUT_ITERATOR>
+        void parse_batch(const CONTEXT& prototype, INPUT_ITERATOR begin, INPUT_ITERATOR end, std::vector<size_t>& errors)
+        {
+            parse_batch(prototype, begin, end, errors, typename CONTEXT::default_action(), ignore_batch_result());
+        }
+}
+
+#endif
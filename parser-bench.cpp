@@ -0,0 +1,533 @@
+//construction and parse throughput benchmarks:
+//
+//  parser-bench [-max TOKENS] [-threads N] [-synthetic RULES]
+//
+//runs every grammar of the corpus below and prints one JSON object per line
+//(grammar statistics, construction times, parse throughput per driver and
+//input size, peak RSS), so the output can be collected and compared across
+//releases. Build with g++ -std=c++11 -O2 -pthread parser-bench.cpp.
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "parser.hpp"
+#include "parser-glr.hpp"
+#include "parser-lexer.hpp"
+#include "parser-parallel.hpp"
+#include "parser-pipeline.hpp"
+#include "parser-tree.hpp"
+
+typedef parser::default_parser::symbol symbol;
+typedef parser::default_parser::rule rule;
+typedef std::chrono::steady_clock bench_clock;
+
+struct token
+{
+    symbol s;
+    token()
+        :s(0)
+    {}
+    token(symbol s)
+        :s(s)
+    {}
+    token(symbol s, const char*, const char*)
+        :s(s)
+    {}
+    template <typename RULE, typename ITERATOR>
+        token(const RULE& r, ITERATOR, ITERATOR)
+        :s(r.get_left_hand())
+        {}
+    const symbol& get_symbol() const
+    {
+        return s;
+    }
+};
+
+struct srule
+{
+    symbol left_hand;
+    const char* right_hand;
+    int precedence;
+    parser::ASSOCIATIVITY assoc;
+};
+
+//xorshift, so that the inputs are the same on every platform
+struct random_source
+{
+    unsigned int state;
+    random_source()
+        :state(2463534242u)
+    {}
+    unsigned int operator()(unsigned int bound)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state % bound;
+    }
+};
+
+typedef std::vector<token> token_list;
+
+struct grammar
+{
+    const char* name;
+    parser::default_parser rules;
+    symbol start;
+    //appends a sentence of about size tokens
+    void (*generate)(token_list& out, size_t size, random_source& random);
+};
+
+static void add_rules(parser::default_parser& p, const char* symbols, const srule* rules, size_t count)
+{
+    p.symbols.assign(symbols, symbols + strlen(symbols));
+    for (size_t i = 0; i < count; ++i) {
+        const char* right_hand = rules[i].right_hand;
+        p.rules.push_back(rule(rules[i].left_hand, right_hand, right_hand + strlen(right_hand),
+                    rules[i].precedence, rules[i].assoc));
+    }
+}
+
+static void emit(token_list& out, const char* text)
+{
+    while (*text)
+        out.push_back(token(*text++));
+}
+
+//arithmetic with precedence
+static const srule arithmetic_rules[] = {
+    {'s', "e$", 0, parser::NOASSOC},
+    {'e', "e+e", 1, parser::LEFT_ASSOC},
+    {'e', "e-e", 1, parser::LEFT_ASSOC},
+    {'e', "e*e", 2, parser::LEFT_ASSOC},
+    {'e', "e/e", 2, parser::LEFT_ASSOC},
+    {'e', "e^e", 3, parser::RIGHT_ASSOC},
+    {'e', "-e", 4, parser::NOASSOC},
+    {'e', "(e)", 5, parser::NOASSOC},
+    {'e', "i", 5, parser::NOASSOC}};
+
+static void arithmetic_operand(token_list& out, random_source& random, unsigned int depth)
+{
+    if (random(8) == 0)
+        out.push_back(token('-'));
+    if (depth < 16 && random(6) == 0) {
+        out.push_back(token('('));
+        for (unsigned int i = random(4); ; --i) {
+            arithmetic_operand(out, random, depth + 1);
+            if (!i)
+                break;
+            out.push_back(token("+-*/^"[random(5)]));
+        }
+        out.push_back(token(')'));
+    } else {
+        out.push_back(token('i'));
+    }
+}
+static void generate_arithmetic(token_list& out, size_t size, random_source& random)
+{
+    for (;;) {
+        arithmetic_operand(out, random, 0);
+        if (out.size() + 1 >= size)
+            break;
+        out.push_back(token("+-*/^"[random(5)]));
+    }
+    out.push_back(token('$'));
+}
+
+//JSON: s string, n number, t true, f false, z null
+static const srule json_rules[] = {
+    {'S', "V$", 0, parser::NOASSOC},
+    {'V', "O", 0, parser::NOASSOC},
+    {'V', "A", 0, parser::NOASSOC},
+    {'V', "s", 0, parser::NOASSOC},
+    {'V', "n", 0, parser::NOASSOC},
+    {'V', "t", 0, parser::NOASSOC},
+    {'V', "f", 0, parser::NOASSOC},
+    {'V', "z", 0, parser::NOASSOC},
+    {'O', "{}", 0, parser::NOASSOC},
+    {'O', "{M}", 0, parser::NOASSOC},
+    {'M', "P", 0, parser::NOASSOC},
+    {'M', "M,P", 0, parser::NOASSOC},
+    {'P', "s:V", 0, parser::NOASSOC},
+    {'A', "[]", 0, parser::NOASSOC},
+    {'A', "[E]", 0, parser::NOASSOC},
+    {'E', "V", 0, parser::NOASSOC},
+    {'E', "E,V", 0, parser::NOASSOC}};
+
+static void json_value(token_list& out, random_source& random, unsigned int depth)
+{
+    unsigned int kind = depth < 8 ? random(9) : 2 + random(7);
+    if (kind < 2) {
+        out.push_back(token(kind ? '{' : '['));
+        for (unsigned int i = random(6); i; --i) {
+            if (kind)
+                emit(out, "s:");
+            json_value(out, random, depth + 1);
+            if (i > 1)
+                out.push_back(token(','));
+        }
+        out.push_back(token(kind ? '}' : ']'));
+    } else {
+        out.push_back(token("snnsstfz"[kind - 2]));
+    }
+}
+static void generate_json(token_list& out, size_t size, random_source& random)
+{
+    out.push_back(token('['));
+    for (;;) {
+        json_value(out, random, 1);
+        if (out.size() + 2 >= size)
+            break;
+        out.push_back(token(','));
+    }
+    emit(out, "]$");
+}
+
+//a subset of C expression statements: a identifier, n number, E ==,
+//& &&, | ||, = assignment
+static const srule c_rules[] = {
+    {'s', "L$", 0, parser::NOASSOC},
+    {'L', "x", 0, parser::NOASSOC},
+    {'L', "Lx", 0, parser::NOASSOC},
+    {'x', "e;", 0, parser::NOASSOC},
+    {'x', "a=e;", 1, parser::NOASSOC},
+    {'e', "e|e", 1, parser::LEFT_ASSOC},
+    {'e', "e&e", 2, parser::LEFT_ASSOC},
+    {'e', "eEe", 3, parser::LEFT_ASSOC},
+    {'e', "e<e", 4, parser::LEFT_ASSOC},
+    {'e', "e+e", 5, parser::LEFT_ASSOC},
+    {'e', "e-e", 5, parser::LEFT_ASSOC},
+    {'e', "e*e", 6, parser::LEFT_ASSOC},
+    {'e', "e/e", 6, parser::LEFT_ASSOC},
+    {'e', "-e", 7, parser::NOASSOC},
+    {'e', "!e", 7, parser::NOASSOC},
+    {'e', "a(r)", 8, parser::NOASSOC},
+    {'e', "a()", 8, parser::NOASSOC},
+    {'e', "(e)", 8, parser::NOASSOC},
+    {'e', "a", 0, parser::NOASSOC},
+    {'e', "n", 8, parser::NOASSOC},
+    {'r', "e", 0, parser::NOASSOC},
+    {'r', "r,e", 0, parser::NOASSOC}};
+
+static void c_expression(token_list& out, random_source& random, unsigned int depth)
+{
+    for (unsigned int operands = 1 + random(4); ; --operands) {
+        unsigned int kind = depth < 12 ? random(12) : 3 + random(9);
+        if (kind == 0) {
+            out.push_back(token('('));
+            c_expression(out, random, depth + 1);
+            out.push_back(token(')'));
+        } else if (kind == 1) {
+            emit(out, "a(");
+            for (unsigned int i = random(4); i; --i) {
+                c_expression(out, random, depth + 1);
+                if (i > 1)
+                    out.push_back(token(','));
+            }
+            out.push_back(token(')'));
+        } else if (kind == 2) {
+            out.push_back(token(random(2) ? '-' : '!'));
+            out.push_back(token('a'));
+        } else {
+            out.push_back(token(kind & 1 ? 'a' : 'n'));
+        }
+        if (operands == 1)
+            break;
+        out.push_back(token("|&E<+-*/"[random(8)]));
+    }
+}
+static void generate_c(token_list& out, size_t size, random_source& random)
+{
+    do {
+        if (random(3) == 0)
+            emit(out, "a=");
+        c_expression(out, random, 0);
+        out.push_back(token(';'));
+    } while (out.size() + 1 < size);
+    out.push_back(token('$'));
+}
+
+//a statement list with as many statement kinds as asked for: statement k
+//is its keyword (symbol KEYWORD + k) followed by one of a few shapes over
+//the arithmetic expressions
+enum { SYNTHETIC_KEYWORD = 1000, SYNTHETIC_STATEMENT = 100000 };
+static unsigned int synthetic_kinds;
+static void build_synthetic(parser::default_parser& p, unsigned int rule_count)
+{
+    static const srule common[] = {
+        {'s', "L$", 0, parser::NOASSOC},
+        {'L', "x", 0, parser::NOASSOC},
+        {'L', "Lx", 0, parser::NOASSOC},
+        {'e', "e+e", 1, parser::LEFT_ASSOC},
+        {'e', "e*e", 2, parser::LEFT_ASSOC},
+        {'e', "(e)", 3, parser::NOASSOC},
+        {'e', "i", 3, parser::NOASSOC}};
+    add_rules(p, "sLxe+*()i;,", common, sizeof(common) / sizeof(*common));
+    synthetic_kinds = std::max(1u, rule_count / 4);
+    for (unsigned int k = 0; k < synthetic_kinds; ++k) {
+        symbol keyword = SYNTHETIC_KEYWORD + k, statement = SYNTHETIC_STATEMENT + k;
+        p.symbols.push_back(keyword);
+        p.symbols.push_back(statement);
+        symbol to_statement[] = {statement};
+        symbol plain[] = {keyword, 'e', ';'};
+        symbol pair[] = {keyword, 'e', ',', 'e', ';'};
+        symbol block[] = {keyword, '(', 'L', ')'};
+        p.rules.push_back(rule('x', to_statement, to_statement + 1));
+        p.rules.push_back(rule(statement, plain, plain + 3));
+        p.rules.push_back(rule(statement, pair, pair + 5));
+        p.rules.push_back(rule(statement, block, block + 4));
+    }
+}
+static void synthetic_statement(token_list& out, random_source& random, unsigned int depth)
+{
+    out.push_back(token(SYNTHETIC_KEYWORD + random(synthetic_kinds)));
+    unsigned int shape = depth < 4 ? random(3) : random(2);
+    if (shape == 2) {
+        out.push_back(token('('));
+        for (unsigned int i = 1 + random(3); i; --i)
+            synthetic_statement(out, random, depth + 1);
+        out.push_back(token(')'));
+        return;
+    }
+    emit(out, random(2) ? "i+i*i" : "(i+i)");
+    if (shape == 1)
+        emit(out, ",i");
+    out.push_back(token(';'));
+}
+static void generate_synthetic(token_list& out, size_t size, random_source& random)
+{
+    do
+        synthetic_statement(out, random, 0);
+    while (out.size() + 1 < size);
+    out.push_back(token('$'));
+}
+
+static double seconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static long peak_rss_kb()
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        return usage.ru_maxrss;
+#endif
+    return -1;
+}
+
+//best of a few runs, every run on a fresh context
+template <typename CONTEXT, typename AUTOMATON>
+    static double time_feed_symbol(const AUTOMATON& automaton, symbol start, const token_list& input)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 3; ++run) {
+            bench_clock::time_point begin = bench_clock::now();
+            CONTEXT context(automaton, start);
+            for (size_t i = 0; i < input.size(); ++i)
+                context.feed_symbol(input[i]);
+            best = std::min(best, seconds_since(begin));
+        }
+        return best;
+    }
+template <typename CONTEXT, typename AUTOMATON>
+    static double time_feed_symbols(const AUTOMATON& automaton, const token_list& input)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 3; ++run) {
+            token_list copy(input);
+            bench_clock::time_point begin = bench_clock::now();
+            CONTEXT context(automaton);
+            if (context.feed_symbols(copy.begin(), copy.end()) != copy.end())
+                throw std::runtime_error("syntax error in generated input");
+            best = std::min(best, seconds_since(begin));
+        }
+        return best;
+    }
+template <typename CONTEXT, typename AUTOMATON>
+    static double time_feed_parallel(const AUTOMATON& automaton, const token_list& input, unsigned int threads)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 3; ++run) {
+            token_list copy(input);
+            bench_clock::time_point begin = bench_clock::now();
+            CONTEXT context(automaton);
+            if (parser::feed_parallel(context, copy.begin(), copy.end(), typename CONTEXT::default_action(), threads) != copy.end())
+                throw std::runtime_error("syntax error in generated input");
+            best = std::min(best, seconds_since(begin));
+        }
+        return best;
+    }
+
+//the input as text, one byte per token, and a lexer for it; false if a
+//symbol does not fit a byte
+static bool lex_input(const token_list& input, std::string& text, parser::default_lexer& lexer)
+{
+    bool seen[128] = {false};
+    text.clear();
+    for (size_t i = 0; i < input.size(); ++i) {
+        symbol s = input[i].get_symbol();
+        if (s >= 128)
+            return false;
+        text += char(s);
+        if (!seen[s]) {
+            seen[s] = true;
+            //letters are literals: \s, \n and the like are classes
+            char escaped[] = {'\\', char(s), 0};
+            lexer.add(isalnum(s) ? escaped + 1 : escaped, s);
+        }
+    }
+    lexer.compile();
+    return true;
+}
+template <typename CONTEXT, typename AUTOMATON>
+    static double time_pipelined(const AUTOMATON& automaton, parser::default_lexer& lexer, const std::string& text)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 3; ++run) {
+            bench_clock::time_point begin = bench_clock::now();
+            CONTEXT context(automaton);
+            if (parser::parse_pipelined(lexer, text.data(), text.data() + text.size(), context).error_offset
+                    != parser::pipeline_result::no_error)
+                throw std::runtime_error("syntax error in generated input");
+            best = std::min(best, seconds_since(begin));
+        }
+        return best;
+    }
+
+//adapters giving the table contexts the (automaton, start) constructor
+template <typename TABLE>
+    struct table_driver : parser::default_parser::table_context<token>
+    {
+        table_driver(const TABLE& table, symbol)
+            :parser::default_parser::table_context<token>(table)
+        {}
+    };
+template <typename TABLE>
+    struct compressed_driver : parser::default_parser::compressed_context<token>
+    {
+        compressed_driver(const TABLE& table, symbol)
+            :parser::default_parser::compressed_context<token>(table)
+        {}
+    };
+struct glr_driver : parser::glr_context<parser::default_parser, token>
+{
+    glr_driver(const parser::glr_table<parser::default_parser>& table, symbol)
+        :parser::glr_context<parser::default_parser, token>(table)
+    {}
+};
+
+static void report_parse(const char* grammar_name, const char* driver, size_t tokens, double seconds)
+{
+    printf("{\"grammar\":\"%s\",\"measure\":\"parse\",\"driver\":\"%s\",\"tokens\":%lu,\"seconds\":%.6f,\"tokens_per_second\":%.0f}\n",
+            grammar_name, driver, (unsigned long)tokens, seconds, tokens / seconds);
+}
+
+static void run(grammar& g, size_t max_tokens, unsigned int threads)
+{
+    typedef parser::default_parser P;
+    P& p = g.rules;
+
+    p.clear_cache();
+    bench_clock::time_point begin = bench_clock::now();
+    P::item_set_list states = p.generate_states(g.start);
+    double serial_seconds = seconds_since(begin);
+
+    P::item_set_list parallel_states;
+    std::vector<unsigned int> transitions;
+    begin = bench_clock::now();
+    p.generate_states_parallel(g.start, parallel_states, transitions, threads);
+    double parallel_seconds = seconds_since(begin);
+
+    P::conflict_list conflicts;
+    begin = bench_clock::now();
+    P::parse_table table = p.compile_lalr(g.start, conflicts);
+    double lalr_seconds = seconds_since(begin);
+    P::compressed_table compressed(table);
+    P::parse_table folded(table);
+    folded.fold_unit_rules();
+    parser::glr_table<P> glr(p, g.start);
+
+    printf("{\"grammar\":\"%s\",\"measure\":\"construction\",\"rules\":%lu,\"symbols\":%lu,\"states\":%lu,\"conflicts\":%lu,"
+            "\"generate_states_seconds\":%.6f,\"parallel_seconds\":%.6f,\"threads\":%u,\"compile_lalr_seconds\":%.6f,"
+            "\"table_bytes\":%lu,\"compressed_bytes\":%u}\n",
+            g.name, (unsigned long)p.rules.size(), (unsigned long)table.column_count(), (unsigned long)states.size(),
+            (unsigned long)conflicts.size(), serial_seconds, parallel_seconds, threads, lalr_seconds,
+            (unsigned long)(sizeof(P::table_action) * table.actions.size() + sizeof(unsigned int) * table.gotos.size()),
+            compressed.size_in_bytes());
+
+    for (size_t size = 1000; size <= max_tokens; size *= 10) {
+        token_list input;
+        random_source random;
+        g.generate(input, size, random);
+        report_parse(g.name, "interpreting", input.size(), time_feed_symbol<P::context<token> >(p, g.start, input));
+        report_parse(g.name, "table", input.size(), time_feed_symbol<table_driver<P::parse_table> >(table, g.start, input));
+        report_parse(g.name, "table_folded", input.size(), time_feed_symbol<table_driver<P::parse_table> >(folded, g.start, input));
+        report_parse(g.name, "compressed", input.size(),
+                time_feed_symbol<compressed_driver<P::compressed_table> >(compressed, g.start, input));
+        report_parse(g.name, "table_batched", input.size(), time_feed_symbols<P::table_context<token> >(table, input));
+        report_parse(g.name, "table_parallel", input.size(), time_feed_parallel<P::table_context<token> >(table, input, threads));
+        report_parse(g.name, "tree", input.size(), time_feed_symbols<parser::tree_context<P::parse_table> >(table, input));
+        report_parse(g.name, "glr", input.size(), time_feed_symbol<glr_driver>(glr, g.start, input));
+        std::string text;
+        parser::default_lexer lexer;
+        if (lex_input(input, text, lexer))
+            report_parse(g.name, "pipelined", input.size(), time_pipelined<P::table_context<token> >(table, lexer, text));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t max_tokens = 1000000;
+    unsigned int threads = 0;
+    unsigned int synthetic_rules = 1000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-max"))
+            max_tokens = strtoul(argv[i + 1], 0, 10);
+        else if (!strcmp(argv[i], "-threads"))
+            threads = strtoul(argv[i + 1], 0, 10);
+        else if (!strcmp(argv[i], "-synthetic"))
+            synthetic_rules = strtoul(argv[i + 1], 0, 10);
+        else {
+            fprintf(stderr, "usage: %s [-max TOKENS] [-threads N] [-synthetic RULES]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    try {
+        grammar corpus[4];
+        corpus[0].name = "arithmetic";
+        corpus[0].start = 's';
+        corpus[0].generate = generate_arithmetic;
+        add_rules(corpus[0].rules, "se+-*/^()i$", arithmetic_rules, sizeof(arithmetic_rules) / sizeof(*arithmetic_rules));
+        corpus[1].name = "json";
+        corpus[1].start = 'S';
+        corpus[1].generate = generate_json;
+        add_rules(corpus[1].rules, "SVOAMPE{}[],:snftz$", json_rules, sizeof(json_rules) / sizeof(*json_rules));
+        corpus[2].name = "c_expressions";
+        corpus[2].start = 's';
+        corpus[2].generate = generate_c;
+        add_rules(corpus[2].rules, "sLxer|&E<+-*/!()an;,=$", c_rules, sizeof(c_rules) / sizeof(*c_rules));
+        corpus[3].name = "synthetic";
+        corpus[3].start = 's';
+        corpus[3].generate = generate_synthetic;
+        build_synthetic(corpus[3].rules, synthetic_rules);
+        corpus[3].rules.symbols.push_back('$');
+        for (size_t i = 0; i < sizeof(corpus) / sizeof(*corpus); ++i)
+            run(corpus[i], max_tokens, threads);
+    } catch (std::exception& ex) {
+        fprintf(stderr, "exception: %s\n", ex.what());
+        return 1;
+    }
+    printf("{\"measure\":\"memory\",\"peak_rss_kb\":%ld}\n", peak_rss_kb());
+    return 0;
+}
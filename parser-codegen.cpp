@@ -0,0 +1,148 @@
+//command line front end of parser-codegen.hpp:
+//
+//  parser-codegen [-lalr] [-name NAME] grammar
+//
+//reads a grammar and writes a directly-coded parser for it to stdout. The
+//grammar file has one statement per line, # starts a comment:
+//
+//  symbols i + * ( ) $ s e
+//  start s
+//  rule s -> e $
+//  rule e -> e + e %prec 1 left
+//
+//a symbol is a single character (its code) or a decimal number of two or
+//more digits; %prec takes a precedence and left, right or none
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "parser.hpp"
+#include "parser-codegen.hpp"
+
+typedef parser::default_parser::symbol symbol;
+typedef parser::default_parser::rule rule;
+
+static bool parse_symbol(const char *word, symbol &s)
+{
+    if (!word[0])
+        return false;
+    if (!word[1]) {
+        s = (unsigned char)word[0];
+        return true;
+    }
+    char *end;
+    unsigned long value = strtoul(word, &end, 10);
+    if (*end)
+        return false;
+    s = value;
+    return true;
+}
+
+static bool parse_grammar(FILE *in, parser::default_parser &p, symbol &start)
+{
+    char line[4096];
+    bool has_start = false;
+    for (unsigned int line_number = 1; fgets(line, sizeof(line), in); ++line_number) {
+        if (char *comment = strchr(line, '#'))
+            *comment = 0;
+        std::vector<char *> words;
+        for (char *word = strtok(line, " \t\r\n"); word; word = strtok(0, " \t\r\n"))
+            words.push_back(word);
+        if (words.empty())
+            continue;
+        symbol s;
+        if (!strcmp(words[0], "symbols")) {
+            for (size_t i = 1; i < words.size(); ++i) {
+                if (!parse_symbol(words[i], s))
+                    goto error;
+                p.symbols.push_back(s);
+            }
+        } else if (!strcmp(words[0], "start")) {
+            if (words.size() != 2 || !parse_symbol(words[1], start))
+                goto error;
+            has_start = true;
+        } else if (!strcmp(words[0], "rule")) {
+            symbol left_hand;
+            if (words.size() < 3 || !parse_symbol(words[1], left_hand) || strcmp(words[2], "->"))
+                goto error;
+            std::vector<symbol> right_hand;
+            int precedence = 0;
+            parser::ASSOCIATIVITY associativity = parser::NOASSOC;
+            for (size_t i = 3; i < words.size(); ++i) {
+                if (!strcmp(words[i], "%prec")) {
+                    if (i + 3 != words.size())
+                        goto error;
+                    precedence = atoi(words[i + 1]);
+                    if (!strcmp(words[i + 2], "left"))
+                        associativity = parser::LEFT_ASSOC;
+                    else if (!strcmp(words[i + 2], "right"))
+                        associativity = parser::RIGHT_ASSOC;
+                    else if (strcmp(words[i + 2], "none"))
+                        goto error;
+                    break;
+                }
+                if (!parse_symbol(words[i], s))
+                    goto error;
+                right_hand.push_back(s);
+            }
+            p.rules.push_back(rule(left_hand, right_hand.begin(), right_hand.end(), precedence, associativity));
+        } else {
+            goto error;
+        }
+        continue;
+error:
+        fprintf(stderr, "line %u: cannot parse statement\n", line_number);
+        return false;
+    }
+    if (!has_start)
+        fprintf(stderr, "missing start statement\n");
+    return has_start;
+}
+
+int main(int argc, char **argv)
+{
+    bool lalr = false;
+    const char *name = "generated_parser";
+    const char *path = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-lalr"))
+            lalr = true;
+        else if (!strcmp(argv[i], "-name") && i + 1 < argc)
+            name = argv[++i];
+        else
+            path = argv[i];
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [-lalr] [-name NAME] grammar\n", argv[0]);
+        return 2;
+    }
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return 1;
+    }
+    parser::default_parser p;
+    symbol start;
+    bool parsed = parse_grammar(in, p, start);
+    fclose(in);
+    if (!parsed)
+        return 1;
+    try {
+        parser::default_parser::parse_table table;
+        if (lalr) {
+            parser::default_parser::conflict_list conflicts;
+            table = p.compile_lalr(start, conflicts);
+            for (size_t i = 0; i < conflicts.size(); ++i)
+                fprintf(stderr, "state %u, lookahead %u: %s\n", conflicts[i].state, conflicts[i].lookahead, conflicts[i].message);
+            if (!conflicts.empty())
+                return 1;
+        } else {
+            table = p.compile(start);
+        }
+        parser::emit_directly_coded(stdout, table, name);
+    } catch (std::exception &ex) {
+        fprintf(stderr, "%s\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
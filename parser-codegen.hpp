@@ -0,0 +1,164 @@
+#ifndef PARSER_CODEGEN_HPP
+#define PARSER_CODEGEN_HPP
+// vim: set cino=; set sw=4; set ts=4
+//writes a compiled parse_table out as a directly-coded parser: a struct
+//with the grammar's rules and a context whose feed_symbol has one case per
+//state, with the shifts, reductions and gotos written inline. The output
+//only depends on parser.hpp and takes the same REDUCE_CALLBACK as
+//basic_context::feed_symbol. Tokens are moved onto the stack, so
+//TOKEN_TYPE can be move-only.
+#include <cstdio>
+#include "parser.hpp"
+
+namespace parser {
+    namespace codegen_detail {
+        inline void emit_symbol(FILE* out, unsigned int s)
+        {
+            if (s >= 32 && s < 127 && s != '\'' && s != '\\' && s != '*' && s != '/')
+                fprintf(out, "%u/*'%c'*/", s, s);
+            else
+                fprintf(out, "%u", s);
+        }
+        inline const char* associativity_name(unsigned int associativity)
+        {
+            switch (associativity) {
+                case LEFT_ASSOC:
+                    return "parser::LEFT_ASSOC";
+                case RIGHT_ASSOC:
+                    return "parser::RIGHT_ASSOC";
+            }
+            return "parser::NOASSOC";
+        }
+    }
+
+    template <typename PARSE_TABLE>
+        void emit_directly_coded(FILE* out, const PARSE_TABLE& table, const char* name)
+        {
+            typedef typename PARSE_TABLE::uint uint;
+            typedef typename PARSE_TABLE::rule rule;
+            typedef typename PARSE_TABLE::table_action table_action;
+            using codegen_detail::emit_symbol;
+            uint width = table.column_count();
+            uint rule_count = table.grammar->end_rules() - table.grammar->begin_rules();
+
+            fprintf(out, "//generated by parser-codegen, do not edit\n");
+            fprintf(out, "#ifndef %s_GENERATED_HPP\n#define %s_GENERATED_HPP\n", name, name);
+            fprintf(out, "#include <stdexcept>\n#include <utility>\n#include \"parser.hpp\"\n\n");
+            fprintf(out, "struct %s\n{\n", name);
+            fprintf(out, "    typedef parser::default_parser::uint uint;\n");
+            fprintf(out, "    typedef parser::default_parser::symbol symbol;\n");
+            fprintf(out, "    typedef parser::default_parser::rule rule;\n");
+            fprintf(out, "    template <typename T>\n        struct types : parser::default_parser::types<T>{};\n\n");
+
+            fprintf(out, "    static const rule& get_rule(uint rule_index)\n    {\n");
+            fprintf(out, "        static const symbol right_hands[] = {0");
+            for (uint r = 0; r < rule_count; ++r) {
+                const rule& current = table.get_rule(r);
+                for (uint i = 0; i < current.size(); ++i) {
+                    fprintf(out, ", ");
+                    emit_symbol(out, current[i]);
+                }
+            }
+            fprintf(out, "};\n        static const rule rules[] = {\n");
+            for (uint r = 0, offset = 1; r < rule_count; ++r) {
+                const rule& current = table.get_rule(r);
+                fprintf(out, "            rule(");
+                emit_symbol(out, current.get_left_hand());
+                fprintf(out, ", right_hands + %u, right_hands + %u, %d, %s)%s\n", offset, offset + uint(current.size()),
+                        current.get_precedence(), codegen_detail::associativity_name(current.get_associativity()),
+                        r + 1 < rule_count ? "," : "");
+                offset += current.size();
+            }
+            fprintf(out, "        };\n        return rules[rule_index];\n    }\n\n");
+
+            //one goto function per nonterminal column
+            for (uint column = 0; column < width; ++column) {
+                bool used = false;
+                for (uint r = 0; r < rule_count; ++r)
+                    used = used || table.get_column(table.get_rule(r).get_left_hand()) == column;
+                if (!used)
+                    continue;
+                fprintf(out, "    static uint goto_%u(uint state)//", column);
+                emit_symbol(out, table.columns[column]);
+                fprintf(out, "\n    {\n        switch (state) {\n");
+                for (uint state = 0; state < table.state_count(); ++state) {
+                    uint target = table.gotos[state * width + column];
+                    if (target != uint(-1))
+                        fprintf(out, "            case %u: return %u;\n", state, target);
+                }
+                fprintf(out, "        }\n        throw std::runtime_error(\"syntax error\");\n    }\n");
+            }
+
+            fprintf(out, "\n    template <typename TOKEN_TYPE>\n        struct context\n        {\n");
+            fprintf(out, "            typename types<uint>::indexed_stack parse_stack;\n");
+            fprintf(out, "            typename types<TOKEN_TYPE>::indexed_stack token_stack;\n\n");
+            fprintf(out, "            context()\n            {\n                parse_stack.push_back(%u);\n            }\n",
+                    table.get_initial_state());
+            fprintf(out, "            struct default_action\n            {\n");
+            fprintf(out, "                template <typename TOKEN_ITERATOR>\n");
+            fprintf(out, "                    TOKEN_TYPE operator()(const rule& rule, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)\n");
+            fprintf(out, "                    {\n                        return TOKEN_TYPE(rule, begin, end);\n                    }\n");
+            fprintf(out, "            };\n");
+            fprintf(out, "            void feed_symbol(const TOKEN_TYPE& lookup_token)\n            {\n");
+            fprintf(out, "                feed_symbol(TOKEN_TYPE(lookup_token), default_action());\n            }\n");
+            fprintf(out, "            void feed_symbol(TOKEN_TYPE&& lookup_token)\n            {\n");
+            fprintf(out, "                feed_symbol(std::move(lookup_token), default_action());\n            }\n");
+            fprintf(out, "            template <typename REDUCE_CALLBACK>\n");
+            fprintf(out, "                void feed_symbol(const TOKEN_TYPE& lookup_token, REDUCE_CALLBACK callback)\n");
+            fprintf(out, "                {\n                    feed_symbol(TOKEN_TYPE(lookup_token), callback);\n                }\n");
+            fprintf(out, "            template <typename REDUCE_CALLBACK>\n");
+            fprintf(out, "                void feed_symbol(TOKEN_TYPE&& lookup_token, REDUCE_CALLBACK callback)\n");
+            fprintf(out, "                {\n                    const symbol lookup = lookup_token.get_symbol();\n");
+            fprintf(out, "                    for (;;) {\n                        switch (parse_stack.back()) {\n");
+            for (uint state = 0; state < table.state_count(); ++state) {
+                fprintf(out, "                            case %u:\n                                switch (lookup) {\n", state);
+                for (uint column = 0; column < width; ++column) {
+                    table_action needed_action = table.actions[state * width + column];
+                    if (needed_action.get_type() == INVALID_ACTION || table.get_column(table.columns[column]) != column)
+                        continue;
+                    //identical actions of later columns share this case
+                    bool seen = false;
+                    for (uint before = 0; before < column; ++before)
+                        seen = seen || table.actions[state * width + before] == needed_action;
+                    if (seen)
+                        continue;
+                    for (uint same = column; same < width; ++same) {
+                        if (table.actions[state * width + same] != needed_action || table.get_column(table.columns[same]) != same)
+                            continue;
+                        fprintf(out, "                                    case ");
+                        emit_symbol(out, table.columns[same]);
+                        fprintf(out, ":\n");
+                    }
+                    if (needed_action.get_type() == SHIFT) {
+                        fprintf(out, "                                        parse_stack.push_back(%u);\n", needed_action.get_value());
+                        fprintf(out, "                                        token_stack.push_back(std::move(lookup_token));\n");
+                        fprintf(out, "                                        return;\n");
+                        continue;
+                    }
+                    uint r = needed_action.get_value();
+                    uint length = table.get_rule(r).size();
+                    fprintf(out, "                                        {\n");
+                    //the goto first, so that a missing one is a syntax error
+                    //before the callback runs
+                    fprintf(out, "                                            uint next = goto_%u(*(parse_stack.end() - %u));\n",
+                            table.get_column(table.get_rule(r).get_left_hand()), length + 1);
+                    fprintf(out, "                                            TOKEN_TYPE new_token = callback(get_rule(%u), token_stack.end() - %u, token_stack.end());\n", r, length);
+                    if (length) {
+                        fprintf(out, "                                            *(token_stack.end() - %u) = std::move(new_token);\n", length);
+                        if (length > 1)
+                            fprintf(out, "                                            token_stack.pop(%u);\n", length - 1);
+                        fprintf(out, "                                            parse_stack.pop(%u);\n", length);
+                    } else {
+                        fprintf(out, "                                            token_stack.push_back(std::move(new_token));\n");
+                    }
+                    fprintf(out, "                                            parse_stack.push_back(next);\n");
+                    fprintf(out, "                                        }\n                                        continue;\n");
+                }
+                fprintf(out, "                                }\n                                break;\n");
+            }
+            fprintf(out, "                        }\n                        throw std::runtime_error(\"syntax error\");\n");
+            fprintf(out, "                    }\n                }\n        };\n};\n\n#endif\n");
+        }
+}
+
+#endif
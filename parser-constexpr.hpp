@@ -0,0 +1,480 @@
+#ifndef PARSER_CONSTEXPR_HPP
+#define PARSER_CONSTEXPR_HPP
+// vim: set cino=; set sw=4; set ts=4
+//LALR(1) tables computed at compile time (requires C++17). A grammar is a
+//type with constexpr data:
+//
+//  struct expression_grammar {
+//      static constexpr unsigned symbols[] = {'i', '+', '$', 's', 'e'};
+//      static constexpr parser::static_rule rules[] = {
+//          {'s', "e$"},
+//          {'e', "e+e", 1, parser::LEFT_ASSOC},
+//          {'e', "i"}};
+//      static constexpr unsigned start_symbol = 's';
+//      static constexpr unsigned max_states = 64;//optional
+//  };
+//
+//static_parser<expression_grammar> holds the tables as constexpr arrays of
+//the smallest integer types that fit, and static_context drives them.
+//Conflicts precedence cannot settle and undeclared symbols are compile
+//errors.
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <type_traits>
+#include "parser.hpp"
+
+namespace parser {
+    struct static_rule
+    {
+        enum { MAX_LENGTH = 16 };
+        typedef unsigned int uint;
+        typedef uint symbol;
+
+        symbol left_hand;
+        symbol right_hand[MAX_LENGTH];
+        uint length;
+        int precedence;
+        ASSOCIATIVITY associativity;
+
+        constexpr static_rule(symbol left_hand, const char* right_hand, int precedence = 0, ASSOCIATIVITY associativity = NOASSOC)
+            :left_hand(left_hand), right_hand(), length(0), precedence(precedence), associativity(associativity)
+        {
+            for (; right_hand[length]; ++length) {
+                if (length == MAX_LENGTH)
+                    throw std::length_error("static_rule right hand is too long");
+                this->right_hand[length] = static_cast<unsigned char>(right_hand[length]);
+            }
+        }
+        constexpr static_rule(symbol left_hand, std::initializer_list<symbol> right_hand, int precedence = 0, ASSOCIATIVITY associativity = NOASSOC)
+            :left_hand(left_hand), right_hand(), length(0), precedence(precedence), associativity(associativity)
+        {
+            for (const symbol* it = right_hand.begin(); it != right_hand.end(); ++it) {
+                if (length == MAX_LENGTH)
+                    throw std::length_error("static_rule right hand is too long");
+                this->right_hand[length++] = *it;
+            }
+        }
+        constexpr const symbol& get_left_hand() const
+        {
+            return left_hand;
+        }
+        constexpr uint size() const
+        {
+            return length;
+        }
+        constexpr const symbol& operator[](uint i) const
+        {
+            return right_hand[i];
+        }
+        constexpr int get_precedence() const
+        {
+            return precedence;
+        }
+        constexpr ASSOCIATIVITY get_associativity() const
+        {
+            return associativity;
+        }
+    };
+
+    namespace static_detail {
+        template <std::size_t N>
+            struct smallest_uint
+            {
+                typedef typename std::conditional<(N <= 0xff), std::uint8_t,
+                        typename std::conditional<(N <= 0xffff), std::uint16_t, std::uint32_t>::type>::type type;
+            };
+
+        template <typename GRAMMAR>
+            constexpr std::size_t count_items()
+            {
+                std::size_t count = 0;
+                for (const static_rule& r : GRAMMAR::rules)
+                    count += r.size() + 1;
+                return count;
+            }
+        template <typename GRAMMAR, typename = void>
+            struct max_states_of
+            {
+                static constexpr std::size_t value = 4 * count_items<GRAMMAR>() + 1;
+            };
+        template <typename GRAMMAR>
+            struct max_states_of<GRAMMAR, std::void_t<decltype(GRAMMAR::max_states)> >
+            {
+                static constexpr std::size_t value = GRAMMAR::max_states;
+            };
+
+        //scratch space of the construction; only its results end up in
+        //the binary
+        template <std::size_t SYMBOLS, std::size_t RULES, std::size_t ITEMS, std::size_t MAX_STATES>
+            struct automaton
+            {
+                static constexpr std::size_t ITEM_WORDS = (ITEMS + 63) / 64;
+                static constexpr std::size_t SYMBOL_WORDS = (SYMBOLS + 63) / 64;
+                static constexpr unsigned NONE = unsigned(-1);
+
+                unsigned rule_left[RULES];//column
+                unsigned rule_begin[RULES];//first item
+                unsigned item_rule[ITEMS];
+                unsigned item_next[ITEMS];//column after the dot or NONE
+                bool has_rules[SYMBOLS];
+                bool nullable[SYMBOLS];
+                std::uint64_t first[SYMBOLS][SYMBOL_WORDS];
+                std::uint64_t states[MAX_STATES][ITEM_WORDS];
+                unsigned transitions[MAX_STATES][SYMBOLS];
+                std::uint64_t lookaheads[MAX_STATES][ITEMS][SYMBOL_WORDS];
+                unsigned actions[MAX_STATES][SYMBOLS];//packed as table_action
+                std::size_t state_count;
+
+                static constexpr bool test(const std::uint64_t* set, std::size_t bit)
+                {
+                    return (set[bit / 64] >> (bit % 64)) & 1;
+                }
+                static constexpr bool add(std::uint64_t* set, std::size_t bit)
+                {
+                    if (test(set, bit))
+                        return false;
+                    set[bit / 64] |= std::uint64_t(1) << (bit % 64);
+                    return true;
+                }
+                static constexpr bool merge(std::uint64_t* to, const std::uint64_t* from, std::size_t words)
+                {
+                    bool changed = false;
+                    for (std::size_t i = 0; i < words; ++i) {
+                        if ((to[i] | from[i]) != to[i]) {
+                            to[i] |= from[i];
+                            changed = true;
+                        }
+                    }
+                    return changed;
+                }
+                constexpr void close(std::uint64_t* set) const
+                {
+                    for (bool changed = true; changed; ) {
+                        changed = false;
+                        for (std::size_t i = 0; i < ITEMS; ++i) {
+                            if (!test(set, i) || item_next[i] == NONE || !has_rules[item_next[i]])
+                                continue;
+                            for (std::size_t r = 0; r < RULES; ++r)
+                                if (rule_left[r] == item_next[i])
+                                    changed |= add(set, rule_begin[r]);
+                        }
+                    }
+                }
+            };
+
+        template <typename GRAMMAR>
+            constexpr unsigned column_of(unsigned symbol)
+            {
+                for (std::size_t i = 0; i < std::size(GRAMMAR::symbols); ++i)
+                    if (GRAMMAR::symbols[i] == symbol)
+                        return i;
+                throw std::logic_error("symbol used by a rule is not declared");
+            }
+
+        //the compile-time counterpart of item_set::get_action_callback
+        template <typename GRAMMAR>
+            constexpr unsigned resolve(unsigned current, unsigned current_rule, ACTION_TYPE new_type, unsigned new_rule)
+            {
+                unsigned update = (new_rule << 2) | new_type;
+                if ((current & 3) == INVALID_ACTION)
+                    return update;
+                const static_rule& old_rule = GRAMMAR::rules[current_rule];
+                const static_rule& rule = GRAMMAR::rules[new_rule];
+                ACTION_TYPE old_type = ACTION_TYPE(current & 3);
+                if (old_type == SHIFT && new_type == SHIFT)
+                    return old_rule.get_precedence() < rule.get_precedence() ? update : current;
+                if (old_rule.get_precedence() > rule.get_precedence())
+                    return current;
+                if (old_rule.get_precedence() < rule.get_precedence())
+                    return update;
+                if (old_rule.get_associativity() != rule.get_associativity())
+                    throw std::logic_error("conflict: actions with same precedence with different associativity");
+                if (old_rule.get_associativity() == NOASSOC)
+                    throw std::logic_error("conflict: actions with no associativity require it");
+                if (old_type == REDUCE && new_type == REDUCE)
+                    throw std::logic_error("reduce/reduce conflict");
+                if (old_rule.get_associativity() == LEFT_ASSOC && new_type == REDUCE)
+                    return update;
+                if (old_rule.get_associativity() == RIGHT_ASSOC && new_type == SHIFT)
+                    return update;
+                return current;
+            }
+
+        //LR(0) states, then LALR(1) lookaheads by propagating them along
+        //closures and transitions until nothing changes
+        template <typename GRAMMAR, typename AUTOMATON>
+            constexpr AUTOMATON build()
+            {
+                constexpr std::size_t SYMBOLS = std::size(GRAMMAR::symbols);
+                constexpr std::size_t RULES = std::size(GRAMMAR::rules);
+                constexpr std::size_t ITEMS = count_items<GRAMMAR>();
+                constexpr std::size_t MAX_STATES = max_states_of<GRAMMAR>::value;
+                constexpr std::size_t IW = AUTOMATON::ITEM_WORDS;
+                constexpr std::size_t SW = AUTOMATON::SYMBOL_WORDS;
+                constexpr unsigned NONE = AUTOMATON::NONE;
+                AUTOMATON a{};
+
+                unsigned next_item = 0;
+                for (std::size_t r = 0; r < RULES; ++r) {
+                    const static_rule& rule = GRAMMAR::rules[r];
+                    a.rule_left[r] = column_of<GRAMMAR>(rule.get_left_hand());
+                    a.has_rules[a.rule_left[r]] = true;
+                    a.rule_begin[r] = next_item;
+                    for (unsigned dot = 0; dot <= rule.size(); ++dot, ++next_item) {
+                        a.item_rule[next_item] = r;
+                        a.item_next[next_item] = dot < rule.size() ? column_of<GRAMMAR>(rule[dot]) : NONE;
+                    }
+                }
+
+                for (std::size_t c = 0; c < SYMBOLS; ++c)
+                    if (!a.has_rules[c])
+                        AUTOMATON::add(a.first[c], c);
+                for (bool changed = true; changed; ) {
+                    changed = false;
+                    for (std::size_t r = 0; r < RULES; ++r) {
+                        bool all_nullable = true;
+                        for (unsigned i = a.rule_begin[r]; a.item_next[i] != NONE; ++i) {
+                            changed |= AUTOMATON::merge(a.first[a.rule_left[r]], a.first[a.item_next[i]], SW);
+                            if (!a.nullable[a.item_next[i]]) {
+                                all_nullable = false;
+                                break;
+                            }
+                        }
+                        if (all_nullable && !a.nullable[a.rule_left[r]]) {
+                            a.nullable[a.rule_left[r]] = true;
+                            changed = true;
+                        }
+                    }
+                }
+
+                unsigned start = column_of<GRAMMAR>(GRAMMAR::start_symbol);
+                for (std::size_t r = 0; r < RULES; ++r)
+                    if (a.rule_left[r] == start)
+                        AUTOMATON::add(a.states[0], a.rule_begin[r]);
+                a.close(a.states[0]);
+                a.state_count = 1;
+                for (std::size_t s = 0; s < a.state_count; ++s) {
+                    for (std::size_t c = 0; c < SYMBOLS; ++c) {
+                        std::uint64_t kernel[IW] = {};
+                        bool empty = true;
+                        for (std::size_t i = 0; i < ITEMS; ++i) {
+                            if (AUTOMATON::test(a.states[s], i) && a.item_next[i] == c) {
+                                AUTOMATON::add(kernel, i + 1);
+                                empty = false;
+                            }
+                        }
+                        a.transitions[s][c] = NONE;
+                        if (empty)
+                            continue;
+                        a.close(kernel);
+                        std::size_t found = 0;
+                        for (; found < a.state_count; ++found) {
+                            bool same = true;
+                            for (std::size_t w = 0; w < IW; ++w)
+                                same = same && a.states[found][w] == kernel[w];
+                            if (same)
+                                break;
+                        }
+                        if (found == a.state_count) {
+                            if (found == MAX_STATES)
+                                throw std::length_error("grammar needs more than max_states states");
+                            for (std::size_t w = 0; w < IW; ++w)
+                                a.states[found][w] = kernel[w];
+                            ++a.state_count;
+                        }
+                        a.transitions[s][c] = found;
+                    }
+                }
+
+                for (bool changed = true; changed; ) {
+                    changed = false;
+                    for (std::size_t s = 0; s < a.state_count; ++s) {
+                        for (bool closing = true; closing; ) {
+                            closing = false;
+                            for (std::size_t i = 0; i < ITEMS; ++i) {
+                                unsigned next = a.item_next[i];
+                                if (!AUTOMATON::test(a.states[s], i) || next == NONE || !a.has_rules[next])
+                                    continue;
+                                std::uint64_t spread[SW] = {};
+                                std::size_t j = i + 1;
+                                for (; a.item_next[j] != NONE; ++j) {
+                                    AUTOMATON::merge(spread, a.first[a.item_next[j]], SW);
+                                    if (!a.nullable[a.item_next[j]])
+                                        break;
+                                }
+                                if (a.item_next[j] == NONE)
+                                    AUTOMATON::merge(spread, a.lookaheads[s][i], SW);
+                                for (std::size_t r = 0; r < RULES; ++r)
+                                    if (a.rule_left[r] == next)
+                                        closing |= AUTOMATON::merge(a.lookaheads[s][a.rule_begin[r]], spread, SW);
+                            }
+                            changed |= closing;
+                        }
+                        for (std::size_t i = 0; i < ITEMS; ++i) {
+                            if (!AUTOMATON::test(a.states[s], i) || a.item_next[i] == NONE)
+                                continue;
+                            unsigned target = a.transitions[s][a.item_next[i]];
+                            changed |= AUTOMATON::merge(a.lookaheads[target][i + 1], a.lookaheads[s][i], SW);
+                        }
+                    }
+                }
+
+                for (std::size_t s = 0; s < a.state_count; ++s) {
+                    for (std::size_t c = 0; c < SYMBOLS; ++c) {
+                        unsigned chosen = INVALID_ACTION;
+                        for (std::size_t i = 0; i < ITEMS; ++i) {
+                            if (!AUTOMATON::test(a.states[s], i))
+                                continue;
+                            if (a.item_next[i] == c)
+                                chosen = resolve<GRAMMAR>(chosen, chosen >> 2, SHIFT, a.item_rule[i]);
+                            else if (a.item_next[i] == NONE && AUTOMATON::test(a.lookaheads[s][i], c))
+                                chosen = resolve<GRAMMAR>(chosen, chosen >> 2, REDUCE, a.item_rule[i]);
+                        }
+                        //shifts are resolved by rule, but store their target
+                        if ((chosen & 3) == SHIFT)
+                            chosen = (a.transitions[s][c] << 2) | SHIFT;
+                        a.actions[s][c] = chosen;
+                    }
+                }
+                return a;
+            }
+    }
+
+    template <typename GRAMMAR>
+        struct static_parser
+        {
+            typedef unsigned int uint;
+            typedef unsigned int symbol;
+            typedef static_rule rule;
+            typedef parser_types<default_parser_params>::table_action table_action;
+            template <typename T>
+                struct types : default_parser_params::types<T>{};
+
+            static constexpr std::size_t symbol_count = std::size(GRAMMAR::symbols);
+            static constexpr std::size_t rule_count = std::size(GRAMMAR::rules);
+            typedef static_detail::automaton<symbol_count, rule_count,
+                    static_detail::count_items<GRAMMAR>(), static_detail::max_states_of<GRAMMAR>::value> automaton_type;
+            static constexpr automaton_type automaton = static_detail::build<GRAMMAR, automaton_type>();
+            static constexpr std::size_t state_count = automaton.state_count;
+
+            //the largest value of each type is left free for "none"
+            typedef typename static_detail::smallest_uint<state_count>::type state;
+            typedef typename static_detail::smallest_uint<symbol_count>::type column;
+            typedef typename static_detail::smallest_uint<
+                ((state_count > rule_count ? state_count : rule_count) << 2) | 3>::type cell;
+            static constexpr state invalid_state = state(-1);
+
+            static constexpr symbol max_symbol()
+            {
+                symbol rez = 0;
+                for (symbol s : GRAMMAR::symbols)
+                    rez = s > rez ? s : rez;
+                return rez;
+            }
+            //symbols up to this value are mapped to columns by direct
+            //indexing, larger alphabets by binary search
+            static constexpr bool direct_columns = max_symbol() < 1024;
+            static constexpr std::size_t column_map_size = direct_columns ? max_symbol() + 1 : symbol_count;
+
+            static constexpr std::array<cell, state_count * symbol_count> make_actions()
+            {
+                std::array<cell, state_count * symbol_count> rez{};
+                for (std::size_t s = 0; s < state_count; ++s)
+                    for (std::size_t c = 0; c < symbol_count; ++c)
+                        rez[s * symbol_count + c] = automaton.actions[s][c];
+                return rez;
+            }
+            static constexpr std::array<state, state_count * symbol_count> make_gotos()
+            {
+                std::array<state, state_count * symbol_count> rez{};
+                for (std::size_t s = 0; s < state_count; ++s)
+                    for (std::size_t c = 0; c < symbol_count; ++c)
+                        rez[s * symbol_count + c] = automaton.transitions[s][c] == automaton_type::NONE ?
+                            state(-1) : state(automaton.transitions[s][c]);
+                return rez;
+            }
+            //column per symbol value when direct_columns, otherwise the
+            //symbols sorted and their columns in the same order
+            static constexpr std::array<column, column_map_size> make_column_map()
+            {
+                std::array<column, column_map_size> rez{};
+                if constexpr (direct_columns) {
+                    for (std::size_t i = 0; i < rez.size(); ++i)
+                        rez[i] = symbol_count;
+                    for (std::size_t c = symbol_count; c-- > 0; )
+                        rez[GRAMMAR::symbols[c]] = c;
+                } else {
+                    std::array<symbol, symbol_count> sorted = make_sorted_symbols();
+                    for (std::size_t i = 0; i < symbol_count; ++i)
+                        rez[i] = column_of(sorted[i]);
+                }
+                return rez;
+            }
+            static constexpr std::array<symbol, symbol_count> make_sorted_symbols()
+            {
+                std::array<symbol, symbol_count> rez{};
+                for (std::size_t c = 0; c < symbol_count; ++c) {
+                    std::size_t at = c;
+                    for (; at > 0 && rez[at - 1] > GRAMMAR::symbols[c]; --at)
+                        rez[at] = rez[at - 1];
+                    rez[at] = GRAMMAR::symbols[c];
+                }
+                return rez;
+            }
+            static constexpr column column_of(symbol s)
+            {
+                return static_detail::column_of<GRAMMAR>(s);
+            }
+
+            static constexpr std::array<cell, state_count * symbol_count> actions = make_actions();
+            static constexpr std::array<state, state_count * symbol_count> gotos = make_gotos();
+            static constexpr std::array<column, column_map_size> column_map = make_column_map();
+            static constexpr std::array<symbol, symbol_count> sorted_symbols = make_sorted_symbols();
+
+            //returns symbol_count for symbols outside of the grammar
+            static uint get_column(const symbol& s)
+            {
+                if constexpr (direct_columns) {
+                    return s < column_map_size ? column_map[s] : symbol_count;
+                } else {
+                    const symbol* found = std::lower_bound(sorted_symbols.begin(), sorted_symbols.end(), s);
+                    return found != sorted_symbols.end() && *found == s ? column_map[found - sorted_symbols.begin()] : symbol_count;
+                }
+            }
+            state get_initial_state() const
+            {
+                return 0;
+            }
+            table_action get_action(state current, const symbol& s) const
+            {
+                table_action rez;
+                uint c = get_column(s);
+                if (c != symbol_count)
+                    rez.packed = actions[current * symbol_count + c];
+                return rez;
+            }
+            state get_goto(state current, const symbol& s) const
+            {
+                uint c = get_column(s);
+                return c == symbol_count ? state(-1) : gotos[current * symbol_count + c];
+            }
+            const rule& get_rule(uint rule_index) const
+            {
+                return GRAMMAR::rules[rule_index];
+            }
+        };
+    template <typename GRAMMAR>
+        inline constexpr static_parser<GRAMMAR> static_parser_instance{};
+
+    template <typename GRAMMAR, typename TOKEN_TYPE, typename STACK_TYPES = static_parser<GRAMMAR>, typename STATS = no_stats>
+        struct static_context : basic_context<static_parser<GRAMMAR>, TOKEN_TYPE, STACK_TYPES, STATS>
+        {
+            static_context()
+                :basic_context<static_parser<GRAMMAR>, TOKEN_TYPE, STACK_TYPES, STATS>(static_parser_instance<GRAMMAR>, 0)
+            {}
+        };
+}
+
+#endif
@@ -0,0 +1,767 @@
+#ifndef PARSER_GLR_HPP
+#define PARSER_GLR_HPP
+// vim: set cino=; set sw=4; set ts=4
+//generalized LR parsing for grammars with conflicts precedence cannot
+//settle (ambiguous ones included):
+//
+//  parser::glr_table<parser::default_parser> table(p, 's');
+//  parser::glr_context<parser::default_parser, token> context(table);
+//  ... context.feed_symbol(token) ...
+//  parser::glr_context<parser::default_parser, token>::uint root = context.finish();
+//  token value = context.evaluate(root, callback);
+//
+//glr_table is the LALR(1) table of compile_lalr, except that a cell keeps
+//every action precedence and associativity do not rule out; cells with
+//more than one are forks. glr_context runs all of them at once over a
+//graph-structured stack: stacks share their common prefix, and stacks that
+//reach the same state at the same input position are merged into one node
+//(Tomita's algorithm, with Farshi's correction for epsilon rules). Its
+//result is a shared packed parse forest: one node per symbol and span,
+//holding a packed node per derivation, so an ambiguous input yields a
+//forest of polynomial size instead of an exponential number of trees.
+//
+//While a single stack is alive and its cells do not fork, the context
+//keeps that stack as a plain array of states and forest nodes, as a
+//deterministic context would, and builds no graph-structured stack nodes.
+//At a fork the stack moves onto the graph-structured stack, and it comes
+//back to the array once a single stack is left, taking over the entries
+//below with a single edge as reductions need them. Unambiguous stretches
+//therefore run close to the deterministic contexts.
+#include <algorithm>
+#include <utility>
+#include "parser.hpp"
+
+namespace parser {
+    enum {
+        GLR_FORK = 3//table_action type of a cell with several actions
+    };
+
+    template <typename PARSER>
+        struct glr_table
+        {
+            typedef typename PARSER::uint uint;
+            typedef typename PARSER::state state;
+            typedef typename PARSER::symbol symbol;
+            typedef typename PARSER::rule rule;
+            typedef typename PARSER::action action;
+            typedef typename PARSER::table_action table_action;
+            typedef typename PARSER::item_set item_set;
+            typedef typename PARSER::column_map column_map;
+            typedef typename PARSER::lalr_states lalr_states;
+            typedef typename PARSER::lookahead_closure lookahead_closure;
+            template <typename T>
+                struct types : PARSER::template types<T>{};
+
+            const PARSER* grammar;
+            symbol start_symbol;
+            uint initial_state;
+            column_map columns;
+            typename types<table_action>::vector actions;//column count + 1 per state, the last for the end of the input
+            typename types<uint>::vector gotos;
+            typename types<uint>::vector fork_begin;//fork -> first index into fork_actions
+            typename types<table_action>::vector fork_actions;
+            typename types<uint>::vector left_hand_columns;//rule -> column of its left hand
+
+            //collects the actions of a cell; an action survives unless
+            //another one beats it by precedence and associativity
+            struct cell_actions
+            {
+                typename types<action>::vector candidates;
+
+                void operator()(const action& new_action)
+                {
+                    candidates.push_back(new_action);
+                }
+                static bool beats(const action& winner, const action& loser)
+                {
+                    typename item_set::get_action_callback settle(false);
+                    settle(loser);
+                    settle(winner);
+                    return !settle.conflict && settle.result.get_type() == winner.get_type() &&
+                        settle.result.rule_index == winner.rule_index &&
+                        (loser.get_type() != winner.get_type() || loser.rule_index != winner.rule_index);
+                }
+                bool survives(uint index) const
+                {
+                    for (uint i = 0; i < candidates.size(); ++i)
+                        if (beats(candidates[i], candidates[index]))
+                            return false;
+                    return true;
+                }
+            };
+
+            glr_table()
+                :grammar(0), start_symbol(), initial_state(0)
+            {}
+            glr_table(const PARSER& grammar, const symbol& start_symbol, uint thread_count = 1)
+            {
+                build(grammar, start_symbol, thread_count);
+            }
+            void build(const PARSER& grammar, const symbol& start_symbol, uint thread_count = 1)
+            {
+                lalr_states lalr;
+                grammar.build_lalr(start_symbol, lalr, thread_count);
+                this->grammar = &grammar;
+                this->start_symbol = start_symbol;
+                initial_state = 0;
+                columns = grammar.get_analysis().columns;
+                gotos = lalr.transitions;
+                uint width = columns.size();
+                actions.clear();
+                actions.reserve(lalr.states.size() * (width + 1));
+                fork_begin.assign(1, 0);
+                fork_actions.clear();
+                left_hand_columns.clear();
+                for (typename PARSER::rule_iterator it = grammar.begin_rules(); it != grammar.end_rules(); ++it)
+                    left_hand_columns.push_back(columns.get_column(it->get_left_hand()));
+
+                lookahead_closure closure_state(grammar.end_rules() - grammar.begin_rules(), lalr.sets.words_per_set);
+                typename types<cell_actions>::vector cells(width + 1);
+                typename types<table_action>::vector chosen;
+                for (uint i = 0; i < lalr.states.size(); ++i) {
+                    for (uint column = 0; column <= width; ++column)
+                        cells[column].candidates.clear();
+                    grammar.feed_lalr_actions(lalr, i, cells, closure_state);
+                    for (uint column = 0; column <= width; ++column) {
+                        const cell_actions& cell = cells[column];
+                        chosen.clear();
+                        for (uint k = 0; k < cell.candidates.size(); ++k) {
+                            if (!cell.survives(k))
+                                continue;
+                            //every shift on a symbol leads to the same state
+                            table_action next = cell.candidates[k].get_type() == SHIFT ?
+                                table_action::shift(gotos[i * width + column]) :
+                                table_action::reduce(cell.candidates[k].get_rule_index());
+                            if (std::find(chosen.begin(), chosen.end(), next) == chosen.end())
+                                chosen.push_back(next);
+                        }
+                        if (chosen.size() <= 1) {
+                            actions.push_back(chosen.empty() ? table_action() : chosen[0]);
+                            continue;
+                        }
+                        actions.push_back(table_action(GLR_FORK, fork_begin.size() - 1));
+                        fork_actions.insert(fork_actions.end(), chosen.begin(), chosen.end());
+                        fork_begin.push_back(fork_actions.size());
+                    }
+                }
+            }
+            uint column_count() const
+            {
+                return columns.size();
+            }
+            //the column of the end of the input
+            uint end_column() const
+            {
+                return columns.size();
+            }
+            uint state_count() const
+            {
+                return actions.size() / (columns.size() + 1);
+            }
+            uint fork_count() const
+            {
+                return fork_begin.size() - 1;
+            }
+            uint get_initial_state() const
+            {
+                return initial_state;
+            }
+            //returns end_column() for symbols outside of the grammar
+            uint get_column(const symbol& s) const
+            {
+                return columns.get_column(s);
+            }
+            //the action of a cell, of type GLR_FORK if it has several; see
+            //fork_actions_begin and fork_actions_end
+            table_action get_action(uint state, uint column) const
+            {
+                return actions[state * (columns.size() + 1) + column];
+            }
+            const table_action* fork_actions_begin(table_action fork) const
+            {
+                return &fork_actions[0] + fork_begin[fork.get_value()];
+            }
+            const table_action* fork_actions_end(table_action fork) const
+            {
+                return &fork_actions[0] + fork_begin[fork.get_value() + 1];
+            }
+            uint get_goto(uint state, uint column) const
+            {
+                return gotos[state * columns.size() + column];
+            }
+            const rule& get_rule(uint rule_index) const
+            {
+                return grammar->begin_rules()[rule_index];
+            }
+        };
+
+    //a shared packed parse forest. Symbol nodes stand for a symbol over a
+    //span of tokens [begin, end); those of tokens have no packed nodes,
+    //the others have one per derivation: the rule and a child symbol node
+    //per right hand side symbol.
+    template <typename PARSER>
+        struct parse_forest
+        {
+            typedef typename PARSER::uint uint;
+            typedef typename PARSER::symbol symbol;
+            template <typename T>
+                struct types : PARSER::template types<T>{};
+            static const uint none = uint(-1);
+
+            struct symbol_node
+            {
+                symbol s;
+                uint begin, end;
+                uint first_packed, last_packed;
+            };
+            struct packed_node
+            {
+                uint rule_index;
+                uint children;//first index into children
+                uint next;
+            };
+
+            typename types<symbol_node>::vector nodes;
+            typename types<packed_node>::vector packed;
+            typename types<uint>::vector children;
+
+            void clear()
+            {
+                nodes.clear();
+                packed.clear();
+                children.clear();
+            }
+            uint add_symbol(const symbol& s, uint begin, uint end)
+            {
+                symbol_node fresh = {s, begin, end, none, none};
+                nodes.push_back(fresh);
+                return nodes.size() - 1;
+            }
+            bool is_token(uint node) const
+            {
+                return nodes[node].first_packed == none;
+            }
+            bool is_ambiguous(uint node) const
+            {
+                return !is_token(node) && packed[nodes[node].first_packed].next != none;
+            }
+            //adds a derivation unless node already has it; returns whether
+            //it was new
+            bool add_packed(uint node, uint rule_index, const uint* rhs, uint rhs_size)
+            {
+                for (uint p = nodes[node].first_packed; p != none; p = packed[p].next)
+                    if (packed[p].rule_index == rule_index && std::equal(rhs, rhs + rhs_size, children.begin() + packed[p].children))
+                        return false;
+                packed_node fresh = {rule_index, uint(children.size()), none};
+                children.insert(children.end(), rhs, rhs + rhs_size);
+                packed.push_back(fresh);
+                uint added = packed.size() - 1;
+                if (nodes[node].first_packed == none)
+                    nodes[node].first_packed = added;
+                else
+                    packed[nodes[node].last_packed].next = added;
+                nodes[node].last_packed = added;
+                return true;
+            }
+            const uint* get_children(uint packed_index) const
+            {
+                return &children[0] + packed[packed_index].children;
+            }
+        };
+    template <typename PARSER>
+        const typename parse_forest<PARSER>::uint parse_forest<PARSER>::none;
+
+    //drives a glr_table. feed_symbol throws on a token no stack can take
+    //(try_feed_symbol returns PARSE_FAILED instead, and the context can
+    //still take another token), finish does the reductions of the end of the input and
+    //returns the forest node of the start symbol over the whole input.
+    //Tokens are kept for evaluate, which moves them out.
+    template <typename PARSER, typename TOKEN_TYPE, typename STATS = no_stats>
+        struct glr_context
+        {
+            typedef glr_table<PARSER> table_type;
+            typedef parse_forest<PARSER> forest_type;
+            typedef typename table_type::uint uint;
+            typedef typename table_type::state state;
+            typedef typename table_type::symbol symbol;
+            typedef typename table_type::rule rule;
+            typedef typename table_type::table_action table_action;
+            template <typename T>
+                struct types : PARSER::template types<T>{};
+            static const uint none = uint(-1);
+
+            //a graph-structured stack node is a state at an input position;
+            //its edges lead to the nodes below it, labelled with the forest
+            //node of the symbol in between
+            struct gss_node
+            {
+                state current;
+                uint level;
+                uint first_edge;
+            };
+            struct gss_edge
+            {
+                uint to;
+                uint label;
+                uint next;
+            };
+            //an entry of the single stack: a state and the forest node of
+            //the symbol below it
+            struct linear_entry
+            {
+                state current;
+                uint label;
+            };
+            enum { LINEAR_REDUCED, LINEAR_DEAD, LINEAR_BLOCKED };
+
+            const table_type* table;
+            STATS stats;
+            forest_type forest;
+            typename types<TOKEN_TYPE>::vector tokens;
+            typename types<gss_node>::vector nodes;
+            typename types<gss_edge>::vector edges;
+            typename types<uint>::vector frontier;//nodes of the current level, in creation order
+            typename types<uint>::vector next_frontier;
+            typename types<uint>::vector node_of_state;//state -> its node at the current level, if there is one
+            typename types<uint>::vector level_symbols;//forest nodes ending at the current level
+            typename types<std::pair<uint, state> >::vector shifts;
+            typename types<uint>::vector added_edges;//new edges into nodes already processed
+            typename types<uint>::vector path;//labels of the path being reduced
+            uint level;
+            uint cursor;//frontier[cursor] is the node whose reductions are being done
+            uint column;//of the lookahead
+            uint root;
+            bool linear;//whether the single stack is in linear_stack
+            uint base_node;//the graph-structured stack node of linear_stack[0]
+            typename types<linear_entry>::vector linear_stack;
+            typename types<linear_entry>::vector saved;//entries of linear_stack the reductions of the lookahead popped, top first
+            uint saved_from;//where they go back
+            uint linear_steps;//reductions of the lookahead
+            typename types<linear_entry>::vector pulled;
+
+            glr_context(const table_type& table)
+                :table(&table), node_of_state(table.state_count(), none)
+            {
+                reset();
+            }
+            //starts a new parse, keeping the storage of the last one
+            void reset()
+            {
+                forest.clear();
+                tokens.clear();
+                nodes.clear();
+                edges.clear();
+                frontier.clear();
+                level_symbols.clear();
+                level = 0;
+                root = none;
+                frontier.push_back(add_node(table->get_initial_state()));
+                enter_linear();
+            }
+            //the number of stacks alive
+            uint stack_count() const
+            {
+                return linear ? 1 : frontier.size();
+            }
+
+            void feed_symbol(const TOKEN_TYPE& lookup_token)
+            {
+                feed_symbol(TOKEN_TYPE(lookup_token));
+            }
+            void feed_symbol(TOKEN_TYPE&& lookup_token)
+            {
+                if (try_feed_symbol(std::move(lookup_token)) != PARSE_OK)
+                    throw std::runtime_error("syntax error");
+            }
+            PARSE_STATUS try_feed_symbol(const TOKEN_TYPE& lookup_token)
+            {
+                return try_feed_symbol(TOKEN_TYPE(lookup_token));
+            }
+            PARSE_STATUS try_feed_symbol(TOKEN_TYPE&& lookup_token)
+            {
+                column = table->get_column(lookup_token.get_symbol());
+                if (column == table->end_column()) {
+                    stats.on_syntax_error();
+                    return PARSE_FAILED;
+                }
+                if (linear) {
+                    table_action needed_action = reduce_linear();
+                    if (needed_action.get_type() == SHIFT) {
+                        uint leaf = forest.add_symbol(lookup_token.get_symbol(), level, level + 1);
+                        tokens.push_back(std::move(lookup_token));
+                        ++level;
+                        linear_entry shifted = {state(needed_action.get_value()), leaf};
+                        linear_stack.push_back(shifted);
+                        stats.on_shift(shifted.current, level);
+                        return PARSE_OK;
+                    }
+                    if (needed_action.get_type() != GLR_FORK) {
+                        stats.on_syntax_error();
+                        return PARSE_FAILED;
+                    }
+                    leave_linear();
+                }
+                reduce_all();
+                if (shifts.empty()) {
+                    stats.on_syntax_error();
+                    return PARSE_FAILED;
+                }
+                uint leaf = forest.add_symbol(lookup_token.get_symbol(), level, level + 1);
+                tokens.push_back(std::move(lookup_token));
+                ++level;
+                next_frontier.clear();
+                for (uint i = 0; i < shifts.size(); ++i) {
+                    uint target = node_at(shifts[i].second);
+                    if (target == none) {
+                        target = add_node(shifts[i].second);
+                        next_frontier.push_back(target);
+                        stats.on_shift(shifts[i].second, level);
+                    }
+                    add_edge(target, shifts[i].first, leaf);
+                }
+                frontier.swap(next_frontier);
+                level_symbols.clear();
+                if (frontier.size() == 1)
+                    enter_linear();
+                return PARSE_OK;
+            }
+            //does the reductions at the end of the input; returns the root
+            //of the forest, or throws if the input is not a sentence
+            uint finish()
+            {
+                column = table->end_column();
+                if (!linear || reduce_linear().get_type() == GLR_FORK) {
+                    if (linear)
+                        leave_linear();
+                    reduce_all();
+                }
+                if (root == none) {
+                    stats.on_syntax_error();
+                    throw std::runtime_error("syntax error");
+                }
+                return root;
+            }
+
+            struct default_action
+            {
+                template <typename TOKEN_ITERATOR>
+                    TOKEN_TYPE operator()(const rule& rule, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                    {
+                        return TOKEN_TYPE(rule, begin, end);
+                    }
+            };
+            //picks the first derivation found
+            struct first_derivation
+            {
+                uint operator()(const forest_type& forest, uint node) const
+                {
+                    return forest.nodes[node].first_packed;
+                }
+            };
+            struct evaluate_frame
+            {
+                uint node;
+                uint packed;
+                uint next_child;
+            };
+            TOKEN_TYPE evaluate(uint node)
+            {
+                return evaluate(node, default_action(), first_derivation());
+            }
+            template <typename REDUCE_CALLBACK>
+                TOKEN_TYPE evaluate(uint node, REDUCE_CALLBACK callback)
+                {
+                    return evaluate(node, callback, first_derivation());
+                }
+            //runs the reduce callbacks over one tree of the forest below
+            //node, bottom up as a deterministic context would; CHOOSE picks
+            //the packed node of each ambiguous symbol node. Moves the tokens
+            //out, so it is done once per parse.
+            template <typename REDUCE_CALLBACK, typename CHOOSE>
+                TOKEN_TYPE evaluate(uint node, REDUCE_CALLBACK callback, CHOOSE choose)
+                {
+                    typedef evaluate_frame frame;
+                    typename types<frame>::vector frames;
+                    typename types<TOKEN_TYPE>::vector values;
+                    frame first = {node, none, 0};
+                    frames.push_back(first);
+                    while (!frames.empty()) {
+                        uint top = frames.size() - 1;
+                        uint current = frames[top].node;
+                        if (forest.is_token(current)) {
+                            values.push_back(std::move(tokens[forest.nodes[current].begin]));
+                            frames.pop_back();
+                            continue;
+                        }
+                        if (frames[top].packed == none)
+                            frames[top].packed = choose(forest, current);
+                        uint packed_index = frames[top].packed;
+                        const rule& reduced = table->get_rule(forest.packed[packed_index].rule_index);
+                        if (frames[top].next_child < reduced.size()) {
+                            frame child = {forest.get_children(packed_index)[frames[top].next_child++], none, 0};
+                            frames.push_back(child);
+                            continue;
+                        }
+                        TOKEN_TYPE value = callback(reduced, values.end() - reduced.size(), values.end());
+                        stats.on_value();
+                        values.erase(values.end() - reduced.size(), values.end());
+                        values.push_back(std::move(value));
+                        frames.pop_back();
+                    }
+                    return std::move(values.back());
+                }
+
+            uint add_node(state current)
+            {
+                return add_node(current, level);
+            }
+            uint add_node(state current, uint at_level)
+            {
+                gss_node fresh = {current, at_level, none};
+                nodes.push_back(fresh);
+                node_of_state[current] = nodes.size() - 1;
+                return nodes.size() - 1;
+            }
+            uint node_at(state current) const
+            {
+                uint found = node_of_state[current];
+                if (found < nodes.size() && nodes[found].level == level && nodes[found].current == current)
+                    return found;
+                return none;
+            }
+            uint add_edge(uint from, uint to, uint label)
+            {
+                gss_edge fresh = {to, label, nodes[from].first_edge};
+                edges.push_back(fresh);
+                nodes[from].first_edge = edges.size() - 1;
+                return edges.size() - 1;
+            }
+            //the forest node of s from begin to the current level
+            uint level_symbol(const symbol& s, uint begin)
+            {
+                for (uint i = 0; i < level_symbols.size(); ++i) {
+                    const typename forest_type::symbol_node& found = forest.nodes[level_symbols[i]];
+                    if (found.begin == begin && found.s == s)
+                        return level_symbols[i];
+                }
+                level_symbols.push_back(forest.add_symbol(s, begin, level));
+                return level_symbols.back();
+            }
+            //keeps the single stack of the frontier in linear_stack
+            void enter_linear()
+            {
+                linear = true;
+                base_node = frontier[0];
+                linear_entry base = {nodes[base_node].current, none};
+                linear_stack.assign(1, base);
+            }
+            //moves linear_stack onto the graph-structured stack
+            void leave_linear()
+            {
+                uint below = base_node;
+                for (uint i = 1; i < linear_stack.size(); ++i) {
+                    uint node = add_node(linear_stack[i].current, linear_level(i));
+                    add_edge(node, below, linear_stack[i].label);
+                    below = node;
+                }
+                frontier.assign(1, below);
+                level_symbols.clear();
+                linear = false;
+            }
+            //the input position of linear_stack[i]
+            uint linear_level(uint i) const
+            {
+                return i ? forest.nodes[linear_stack[i].label].end : nodes[base_node].level;
+            }
+            //does the reductions the lookahead column calls for on the single
+            //stack. Returns the shift, or, with the stack as it was, the
+            //invalid action if the stack dies and a GLR_FORK action if the
+            //graph-structured stack is needed: at a fork, below entries
+            //with several edges, or after more reductions than a grammar
+            //without cycles can do.
+            table_action reduce_linear()
+            {
+                saved.clear();
+                saved_from = linear_stack.size();
+                linear_steps = 0;
+                for (;;) {
+                    table_action needed_action = table->get_action(linear_stack.back().current, column);
+                    if (needed_action.get_type() == REDUCE) {
+                        uint reduced = reduce_linear(needed_action.get_value());
+                        if (reduced == LINEAR_REDUCED)
+                            continue;
+                        needed_action = reduced == LINEAR_DEAD ? table_action() : table_action(GLR_FORK, 0);
+                    }
+                    if (needed_action.get_type() != SHIFT) {
+                        linear_stack.resize(saved_from);
+                        for (uint i = saved.size(); i; --i)
+                            linear_stack.push_back(saved[i - 1]);
+                    }
+                    return needed_action;
+                }
+            }
+            uint reduce_linear(uint rule_index)
+            {
+                const rule& reduced = table->get_rule(rule_index);
+                uint size = reduced.size();
+                //node_of_state has an entry per state
+                if (++linear_steps > node_of_state.size() + saved.size())
+                    return LINEAR_BLOCKED;
+                if (size >= linear_stack.size() && !pull(size + 1 - linear_stack.size()))
+                    return LINEAR_BLOCKED;
+                uint below = linear_stack.size() - 1 - size;
+                for (; saved_from > below + 1; --saved_from)
+                    saved.push_back(linear_stack[saved_from - 1]);
+                uint label = forest.add_symbol(reduced.get_left_hand(), linear_level(below), level);
+                path.resize(size);
+                for (uint i = 0; i < size; ++i)
+                    path[i] = linear_stack[below + 1 + i].label;
+                forest.add_packed(label, rule_index, size ? &path[0] : 0, size);
+                stats.on_reduce(rule_index, level);
+                if (column == table->end_column() && below == 0 && base_node == 0 && reduced.get_left_hand() == table->start_symbol)
+                    root = label;
+                state next = table->get_goto(linear_stack[below].current, table->left_hand_columns[rule_index]);
+                if (next == PARSER::invalid_state)
+                    return LINEAR_DEAD;
+                linear_stack.resize(below + 1);
+                linear_entry pushed = {next, label};
+                linear_stack.push_back(pushed);
+                return LINEAR_REDUCED;
+            }
+            //moves at least needed entries from the graph-structured stack
+            //below linear_stack into it, as long as they have a single edge;
+            //as many as linear_stack holds if there are, so that pulls are rare
+            bool pull(uint needed)
+            {
+                uint count = std::max<uint>(needed, linear_stack.size());
+                pulled.clear();
+                uint node = base_node;
+                while (pulled.size() < count && nodes[node].first_edge != none && edges[nodes[node].first_edge].next == none) {
+                    const gss_edge& edge = edges[nodes[node].first_edge];
+                    linear_entry entry = {nodes[node].current, edge.label};
+                    pulled.push_back(entry);
+                    node = edge.to;
+                }
+                if (pulled.size() < needed)
+                    return false;
+                linear_entry base = {nodes[node].current, none};
+                pulled.push_back(base);
+                std::reverse(pulled.begin(), pulled.end());
+                pulled.insert(pulled.end(), linear_stack.begin() + 1, linear_stack.end());
+                linear_stack.swap(pulled);
+                saved_from += linear_stack.size() - pulled.size();
+                base_node = node;
+                return true;
+            }
+            //does every reduction the lookahead column calls for at the
+            //current level and collects the shifts
+            void reduce_all()
+            {
+                shifts.clear();
+                added_edges.clear();
+                for (cursor = 0; cursor < frontier.size(); ++cursor) {
+                    uint current = frontier[cursor];
+                    table_action needed_action = table->get_action(nodes[current].current, column);
+                    if (needed_action.get_type() == GLR_FORK) {
+                        for (const table_action* it = table->fork_actions_begin(needed_action); it != table->fork_actions_end(needed_action); ++it)
+                            do_action(current, *it);
+                    } else {
+                        do_action(current, needed_action);
+                    }
+                    //a new edge into a node whose reductions were done opens
+                    //paths they did not see (Farshi)
+                    while (!added_edges.empty()) {
+                        uint edge = added_edges.back();
+                        added_edges.pop_back();
+                        for (uint i = 0; i <= cursor; ++i)
+                            redo_reductions(frontier[i], edge);
+                    }
+                }
+            }
+            void do_action(uint node, table_action needed_action)
+            {
+                switch (needed_action.get_type()) {
+                    case SHIFT:
+                        shifts.push_back(std::make_pair(node, needed_action.get_value()));
+                        break;
+                    case REDUCE:
+                        reduce_paths(node, needed_action.get_value(), none);
+                        break;
+                }
+            }
+            void redo_reductions(uint node, uint edge)
+            {
+                table_action needed_action = table->get_action(nodes[node].current, column);
+                if (needed_action.get_type() == GLR_FORK) {
+                    for (const table_action* it = table->fork_actions_begin(needed_action); it != table->fork_actions_end(needed_action); ++it)
+                        if (it->get_type() == REDUCE && !table->get_rule(it->get_value()).empty())
+                            reduce_paths(node, it->get_value(), edge);
+                } else if (needed_action.get_type() == REDUCE && !table->get_rule(needed_action.get_value()).empty()) {
+                    reduce_paths(node, needed_action.get_value(), edge);
+                }
+            }
+            //reduces rule_index along every path from node of its length,
+            //or only those through required_edge if it is not none
+            void reduce_paths(uint node, uint rule_index, uint required_edge)
+            {
+                uint remaining = table->get_rule(rule_index).size();
+                path.resize(remaining);
+                bool used = false;
+                //the deterministic case: follow single edges without recursion
+                while (remaining && nodes[node].first_edge != none && edges[nodes[node].first_edge].next == none) {
+                    uint edge = nodes[node].first_edge;
+                    used = used || edge == required_edge;
+                    path[--remaining] = edges[edge].label;
+                    node = edges[edge].to;
+                }
+                if (remaining)
+                    walk(node, remaining, rule_index, required_edge, used);
+                else if (required_edge == none || used)
+                    reduce_path(node, rule_index);
+            }
+            void walk(uint node, uint remaining, uint rule_index, uint required_edge, bool used)
+            {
+                if (!remaining) {
+                    if (required_edge == none || used)
+                        reduce_path(node, rule_index);
+                    return;
+                }
+                //edges are only ever prepended, so the list from here on
+                //does not change while it is walked
+                for (uint edge = nodes[node].first_edge; edge != none; edge = edges[edge].next) {
+                    path[remaining - 1] = edges[edge].label;
+                    walk(edges[edge].to, remaining - 1, rule_index, required_edge, used || edge == required_edge);
+                }
+            }
+            //reduces the labels in path, which lead down to node
+            void reduce_path(uint node, uint rule_index)
+            {
+                const rule& reduced = table->get_rule(rule_index);
+                uint label = level_symbol(reduced.get_left_hand(), nodes[node].level);
+                forest.add_packed(label, rule_index, path.empty() ? 0 : &path[0], path.size());
+                stats.on_reduce(rule_index, level);
+                if (column == table->end_column() && node == 0 && reduced.get_left_hand() == table->start_symbol)
+                    root = label;
+                state next = table->get_goto(nodes[node].current, table->left_hand_columns[rule_index]);
+                if (next == PARSER::invalid_state)
+                    return;
+                uint target = node_at(next);
+                if (target == none) {
+                    target = add_node(next);
+                    frontier.push_back(target);
+                    add_edge(target, node, label);
+                    return;
+                }
+                for (uint edge = nodes[target].first_edge; edge != none; edge = edges[edge].next)
+                    if (edges[edge].to == node)
+                        return;
+                uint edge = add_edge(target, node, label);
+                if (target <= frontier[cursor])
+                    added_edges.push_back(edge);
+            }
+        };
+    template <typename PARSER, typename TOKEN_TYPE, typename STATS>
+        const typename glr_context<PARSER, TOKEN_TYPE, STATS>::uint glr_context<PARSER, TOKEN_TYPE, STATS>::none;
+}
+
+#endif
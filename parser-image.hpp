@@ -0,0 +1,421 @@
+#ifndef PARSER_IMAGE_HPP
+#define PARSER_IMAGE_HPP
+// vim: set cino=; set sw=4; set ts=4
+//a binary image of a compressed_table that can be used in place, straight
+//from a mapped file:
+//
+//  parser::write_image(file, parser::default_parser::compressed_table(p.compile_lalr('s', conflicts)));
+//  ...
+//  parser::mapped_image image("grammar.lrt", parser::grammar_checksum(p));
+//  parser::image_context<token> context(image.table);
+//
+//The image is a sequence of 32-bit words in the byte order of the machine
+//that wrote it: a header, then arrays whose offsets (in words from the
+//start of the image) are in the header, so it is position independent.
+//The header carries a checksum of the grammar it was built from and one of
+//every other word of the image. table_image checks that every array lies
+//within the image, reads everything in place and never allocates; its
+//rules are views into the image. Unless the checksum is verified the
+//contents of the arrays are trusted.
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <stdint.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "parser.hpp"
+
+namespace parser {
+    namespace image_detail {
+        enum {
+            MAGIC = 0x5450524cu,//"LRPT"
+            VERSION = 2,
+            BYTE_ORDER_MARK = 0x01020304u
+        };
+        //indices of the header words
+        enum {
+            H_MAGIC,
+            H_VERSION,
+            H_BYTE_ORDER,
+            H_WORDS,//size of the image
+            H_GRAMMAR_CHECKSUM,
+            H_PAYLOAD_CHECKSUM,//of the image but this word
+            H_INITIAL_STATE,
+            H_STATE_COUNT,
+            H_RULE_COUNT,
+            H_DIRECT_CLASSES, H_DIRECT_CLASS_COUNT,
+            H_SORTED_SYMBOLS, H_SORTED_CLASSES, H_SORTED_COUNT,
+            H_DEFAULT_REDUCTIONS,
+            H_ACTION_BASE, H_ACTION_ENTRIES, H_ACTION_CHECK, H_ACTION_COUNT,
+            H_GOTO_BASE, H_GOTO_ENTRIES, H_GOTO_CHECK, H_GOTO_COUNT,
+            H_RULE_LEFT_HANDS, H_RULE_PRECEDENCES, H_RULE_ASSOCIATIVITIES, H_RULE_BEGINS, H_RIGHT_HANDS,
+            HEADER_WORDS
+        };
+        struct checksum
+        {
+            uint32_t value;
+            checksum()
+                :value(2166136261u)
+            {}
+            void add(uint32_t word)
+            {
+                value = (value ^ word) * 16777619u;
+            }
+        };
+        inline uint32_t image_checksum(const uint32_t* words, size_t count)
+        {
+            checksum sum;
+            for (size_t i = 0; i < count; ++i)
+                if (i != H_PAYLOAD_CHECKSUM)
+                    sum.add(words[i]);
+            return sum.value;
+        }
+        template <typename VECTOR>
+            inline uint32_t append(std::vector<uint32_t>& image, const VECTOR& words)
+            {
+                uint32_t offset = image.size();
+                for (size_t i = 0; i < words.size(); ++i)
+                    image.push_back(words[i]);
+                return offset;
+            }
+    }
+
+    //ties an image to the rules and symbols of a parser
+    template <typename PARSER>
+        uint32_t grammar_checksum(const PARSER& grammar)
+        {
+            image_detail::checksum sum;
+            for (typename PARSER::symbol_iterator it = grammar.begin_symbols(); it != grammar.end_symbols(); ++it)
+                sum.add(*it);
+            for (typename PARSER::rule_iterator it = grammar.begin_rules(); it != grammar.end_rules(); ++it) {
+                sum.add(it->get_left_hand());
+                sum.add(it->size());
+                for (size_t i = 0; i < it->size(); ++i)
+                    sum.add((*it)[i]);
+                sum.add(it->get_precedence());
+                sum.add(it->get_associativity());
+            }
+            return sum.value;
+        }
+
+    template <typename COMPRESSED_TABLE>
+        void build_image(const COMPRESSED_TABLE& table, std::vector<uint32_t>& image)
+        {
+            using namespace image_detail;
+            typedef typename COMPRESSED_TABLE::rule rule;
+            image.assign(HEADER_WORDS, 0);
+            std::vector<uint32_t> words;
+            uint32_t rule_count = table.grammar->end_rules() - table.grammar->begin_rules();
+
+            uint32_t direct_classes = append(image, table.direct_classes);
+            words.clear();
+            for (size_t i = 0; i < table.sorted_classes.size(); ++i)
+                words.push_back(table.sorted_classes[i].first);
+            uint32_t sorted_symbols = append(image, words);
+            words.clear();
+            for (size_t i = 0; i < table.sorted_classes.size(); ++i)
+                words.push_back(table.sorted_classes[i].second);
+            uint32_t sorted_classes = append(image, words);
+            words.clear();
+            for (size_t i = 0; i < table.default_reductions.size(); ++i)
+                words.push_back(table.default_reductions[i].packed);
+            uint32_t default_reductions = append(image, words);
+            uint32_t action_base = append(image, table.action_base);
+            words.clear();
+            for (size_t i = 0; i < table.action_entries.size(); ++i)
+                words.push_back(table.action_entries[i].packed);
+            uint32_t action_entries = append(image, words);
+            uint32_t action_check = append(image, table.action_check);
+            uint32_t goto_base = append(image, table.goto_base);
+            uint32_t goto_entries = append(image, table.goto_entries);
+            uint32_t goto_check = append(image, table.goto_check);
+
+            std::vector<uint32_t> left_hands, precedences, associativities, begins, right_hands;
+            for (uint32_t r = 0; r < rule_count; ++r) {
+                const rule& current = table.get_rule(r);
+                left_hands.push_back(current.get_left_hand());
+                precedences.push_back(current.get_precedence());
+                associativities.push_back(current.get_associativity());
+                begins.push_back(right_hands.size());
+                for (size_t i = 0; i < current.size(); ++i)
+                    right_hands.push_back(current[i]);
+            }
+            begins.push_back(right_hands.size());
+            uint32_t rule_left_hands = append(image, left_hands);
+            uint32_t rule_precedences = append(image, precedences);
+            uint32_t rule_associativities = append(image, associativities);
+            uint32_t rule_begins = append(image, begins);
+            uint32_t rule_right_hands = append(image, right_hands);
+
+            uint32_t* header = &image[0];
+            header[H_MAGIC] = MAGIC;
+            header[H_VERSION] = VERSION;
+            header[H_BYTE_ORDER] = BYTE_ORDER_MARK;
+            header[H_WORDS] = image.size();
+            header[H_GRAMMAR_CHECKSUM] = grammar_checksum(*table.grammar);
+            header[H_INITIAL_STATE] = table.get_initial_state();
+            header[H_STATE_COUNT] = table.state_count();
+            header[H_RULE_COUNT] = rule_count;
+            header[H_DIRECT_CLASSES] = direct_classes;
+            header[H_DIRECT_CLASS_COUNT] = table.direct_classes.size();
+            header[H_SORTED_SYMBOLS] = sorted_symbols;
+            header[H_SORTED_CLASSES] = sorted_classes;
+            header[H_SORTED_COUNT] = table.sorted_classes.size();
+            header[H_DEFAULT_REDUCTIONS] = default_reductions;
+            header[H_ACTION_BASE] = action_base;
+            header[H_ACTION_ENTRIES] = action_entries;
+            header[H_ACTION_CHECK] = action_check;
+            header[H_ACTION_COUNT] = table.action_check.size();
+            header[H_GOTO_BASE] = goto_base;
+            header[H_GOTO_ENTRIES] = goto_entries;
+            header[H_GOTO_CHECK] = goto_check;
+            header[H_GOTO_COUNT] = table.goto_check.size();
+            header[H_RULE_LEFT_HANDS] = rule_left_hands;
+            header[H_RULE_PRECEDENCES] = rule_precedences;
+            header[H_RULE_ASSOCIATIVITIES] = rule_associativities;
+            header[H_RULE_BEGINS] = rule_begins;
+            header[H_RIGHT_HANDS] = rule_right_hands;
+            header[H_PAYLOAD_CHECKSUM] = image_checksum(header, image.size());
+        }
+    template <typename COMPRESSED_TABLE>
+        void write_image(FILE* out, const COMPRESSED_TABLE& table)
+        {
+            std::vector<uint32_t> image;
+            build_image(table, image);
+            if (fwrite(&image[0], sizeof(uint32_t), image.size(), out) != image.size())
+                throw std::runtime_error("cannot write the table image");
+        }
+
+    //a compressed_table read in place from an image
+    struct table_image
+    {
+        typedef default_parser_params::uint uint;
+        typedef uint state;
+        typedef default_parser_params::symbol symbol;
+        typedef parser_types<default_parser_params>::table_action table_action;
+        template <typename T>
+            struct types : default_parser_params::types<T>{};
+        static const uint invalid_state = uint(-1);
+        static const uint no_class = uint(-1);
+
+        //a rule of the image; a view, cheap to copy
+        struct rule
+        {
+            typedef const uint32_t* const_iterator;
+            const uint32_t* right_hand;
+            uint32_t length;
+            symbol left_hand;
+            int precedence;
+            uint associativity;
+
+            symbol get_left_hand() const
+            {
+                return left_hand;
+            }
+            int get_precedence() const
+            {
+                return precedence;
+            }
+            uint get_associativity() const
+            {
+                return associativity;
+            }
+            size_t size() const
+            {
+                return length;
+            }
+            bool empty() const
+            {
+                return !length;
+            }
+            symbol operator[](size_t i) const
+            {
+                return right_hand[i];
+            }
+            const_iterator begin() const
+            {
+                return right_hand;
+            }
+            const_iterator end() const
+            {
+                return right_hand + length;
+            }
+        };
+
+        const uint32_t* words;
+
+        table_image()
+            :words(0)
+        {}
+        //checks the header, that every array lies within the image, the
+        //grammar checksum (unless expected_grammar is 0) and, if
+        //verify_payload is set, the checksum of the image; throws
+        //std::runtime_error if the image does not fit
+        table_image(const void* data, size_t size, uint32_t expected_grammar = 0, bool verify_payload = true)
+            :words(static_cast<const uint32_t*>(data))
+        {
+            using namespace image_detail;
+            if (reinterpret_cast<size_t>(data) % sizeof(uint32_t) || size < HEADER_WORDS * sizeof(uint32_t))
+                throw std::runtime_error("table image is misaligned or truncated");
+            if (words[H_MAGIC] != MAGIC || words[H_VERSION] != VERSION)
+                throw std::runtime_error("not a table image of this version");
+            if (words[H_BYTE_ORDER] != BYTE_ORDER_MARK)
+                throw std::runtime_error("table image has a different byte order");
+            if (size_t(words[H_WORDS]) * sizeof(uint32_t) > size || words[H_WORDS] < HEADER_WORDS)
+                throw std::runtime_error("table image is truncated");
+            if (expected_grammar && words[H_GRAMMAR_CHECKSUM] != expected_grammar)
+                throw std::runtime_error("table image was built from another grammar");
+            if (verify_payload && image_checksum(words, words[H_WORDS]) != words[H_PAYLOAD_CHECKSUM])
+                throw std::runtime_error("table image is corrupt");
+            size_t states = words[H_STATE_COUNT], rules = words[H_RULE_COUNT];
+            if (!fits(H_DIRECT_CLASSES, words[H_DIRECT_CLASS_COUNT])
+                    || !fits(H_SORTED_SYMBOLS, words[H_SORTED_COUNT]) || !fits(H_SORTED_CLASSES, words[H_SORTED_COUNT])
+                    || !fits(H_DEFAULT_REDUCTIONS, states) || !fits(H_ACTION_BASE, states) || !fits(H_GOTO_BASE, states)
+                    || !fits(H_ACTION_ENTRIES, words[H_ACTION_COUNT]) || !fits(H_ACTION_CHECK, words[H_ACTION_COUNT])
+                    || !fits(H_GOTO_ENTRIES, words[H_GOTO_COUNT]) || !fits(H_GOTO_CHECK, words[H_GOTO_COUNT])
+                    || !fits(H_RULE_LEFT_HANDS, rules) || !fits(H_RULE_PRECEDENCES, rules)
+                    || !fits(H_RULE_ASSOCIATIVITIES, rules) || !fits(H_RULE_BEGINS, rules + 1)
+                    || words[H_INITIAL_STATE] >= states)
+                throw std::runtime_error("table image has a section outside of it");
+            const uint32_t* begins = section(H_RULE_BEGINS);
+            for (size_t r = 0; r < rules; ++r)
+                if (begins[r] > begins[r + 1])
+                    throw std::runtime_error("table image has a section outside of it");
+            if (!fits(H_RIGHT_HANDS, rules ? begins[rules] : 0) || (rules && begins[0]))
+                throw std::runtime_error("table image has a section outside of it");
+        }
+        //whether the array at header_word holds count words within the image
+        bool fits(uint header_word, size_t count) const
+        {
+            size_t offset = words[header_word], end = words[image_detail::H_WORDS];
+            return offset >= image_detail::HEADER_WORDS && offset <= end && count <= end - offset;
+        }
+        const uint32_t* section(uint header_word) const
+        {
+            return words + words[header_word];
+        }
+        uint get_initial_state() const
+        {
+            return words[image_detail::H_INITIAL_STATE];
+        }
+        uint state_count() const
+        {
+            return words[image_detail::H_STATE_COUNT];
+        }
+        uint rule_count() const
+        {
+            return words[image_detail::H_RULE_COUNT];
+        }
+        uint32_t get_grammar_checksum() const
+        {
+            return words[image_detail::H_GRAMMAR_CHECKSUM];
+        }
+        uint get_class(const symbol& s) const
+        {
+            using namespace image_detail;
+            uint direct_count = words[H_DIRECT_CLASS_COUNT];
+            if (direct_count || !words[H_SORTED_COUNT])
+                return s < direct_count ? section(H_DIRECT_CLASSES)[s] : no_class;
+            const uint32_t* symbols = section(H_SORTED_SYMBOLS);
+            const uint32_t* found = std::lower_bound(symbols, symbols + words[H_SORTED_COUNT], uint32_t(s));
+            if (found == symbols + words[H_SORTED_COUNT] || *found != s)
+                return no_class;
+            return section(H_SORTED_CLASSES)[found - symbols];
+        }
+        table_action get_action(uint state, const symbol& s) const
+        {
+            using namespace image_detail;
+            table_action rez;
+            rez.packed = section(H_DEFAULT_REDUCTIONS)[state];
+            if (rez.get_type() == REDUCE)
+                return rez;
+            uint symbol_class = get_class(s);
+            if (symbol_class == no_class)
+                return table_action();
+            uint i = section(H_ACTION_BASE)[state] + symbol_class;
+            if (i >= words[H_ACTION_COUNT] || section(H_ACTION_CHECK)[i] != state)
+                return table_action();
+            rez.packed = section(H_ACTION_ENTRIES)[i];
+            return rez;
+        }
+        uint get_goto(uint state, const symbol& s) const
+        {
+            using namespace image_detail;
+            uint symbol_class = get_class(s);
+            if (symbol_class == no_class)
+                return invalid_state;
+            uint i = section(H_GOTO_BASE)[state] + symbol_class;
+            if (i >= words[H_GOTO_COUNT] || section(H_GOTO_CHECK)[i] != state)
+                return invalid_state;
+            return section(H_GOTO_ENTRIES)[i];
+        }
+        rule get_rule(uint rule_index) const
+        {
+            using namespace image_detail;
+            const uint32_t* begins = section(H_RULE_BEGINS);
+            rule rez;
+            rez.right_hand = section(H_RIGHT_HANDS) + begins[rule_index];
+            rez.length = begins[rule_index + 1] - begins[rule_index];
+            rez.left_hand = section(H_RULE_LEFT_HANDS)[rule_index];
+            rez.precedence = int(section(H_RULE_PRECEDENCES)[rule_index]);
+            rez.associativity = section(H_RULE_ASSOCIATIVITIES)[rule_index];
+            return rez;
+        }
+    };
+    template <typename TOKEN_TYPE, typename STACK_TYPES = table_image, typename STATS = no_stats>
+        struct image_context : basic_context<table_image, TOKEN_TYPE, STACK_TYPES, STATS>
+        {
+            image_context(const table_image& table)
+                :basic_context<table_image, TOKEN_TYPE, STACK_TYPES, STATS>(table, table.get_initial_state())
+            {}
+        };
+
+#ifndef _WIN32
+    //maps an image file read-only; processes mapping the same file share
+    //its pages
+    class mapped_image
+    {
+        void* data;
+        size_t size;
+
+        mapped_image(const mapped_image&);
+        mapped_image& operator=(const mapped_image&);
+    public:
+        table_image table;
+
+        explicit mapped_image(const char* path, uint32_t expected_grammar = 0, bool verify_payload = true)
+            :data(MAP_FAILED), size(0)
+        {
+            int fd = open(path, O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("cannot open the table image");
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                size = info.st_size;
+                data = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (data == MAP_FAILED)
+                throw std::runtime_error("cannot map the table image");
+            try {
+                table = table_image(data, size, expected_grammar, verify_payload);
+            } catch (...) {
+                munmap(data, size);
+                throw;
+            }
+        }
+        ~mapped_image()
+        {
+            munmap(data, size);
+        }
+    };
+#endif
+}
+
+#endif
@@ -0,0 +1,269 @@
+#ifndef PARSER_INCREMENTAL_HPP
+#define PARSER_INCREMENTAL_HPP
+// vim: set cino=; set sw=4; set ts=4
+//incremental reparsing of a document kept as a token sequence:
+//
+//  parser::incremental_context<parser::default_parser::parse_table, token> document(table, table.get_initial_state());
+//  document.assign(tokens.begin(), tokens.end());
+//  document.replace(first, last, edited.begin(), edited.end());
+//  ... document.evaluate(callback) ...
+//
+//The document is cut into segments of about segment_size tokens. A segment
+//keeps its tokens, the parse stack (state ids only) before its first token
+//and the actions the parse took over it: shifts and reductions by rule.
+//replace resumes parsing at the segment holding the first replaced token
+//and, past the edit, compares its parse stack with the stored stack of
+//every old segment it reaches. As soon as they are equal the old parse
+//from there on is what the new one would do, so the old segments are kept
+//and reparsing stops: the cost follows the size of the edit and the reach
+//of its effect, not the size of the document.
+//
+//Parsing does not run reduce callbacks; evaluate replays the recorded
+//actions over copies of the tokens when the values are needed. After a
+//syntax error the rest of the document is kept unparsed until an edit
+//makes it parse.
+#include <utility>
+#include "parser.hpp"
+
+namespace parser {
+    template <typename AUTOMATON, typename TOKEN_TYPE, typename STATS = no_stats>
+        struct incremental_context
+        {
+            typedef typename AUTOMATON::uint uint;
+            typedef typename AUTOMATON::state state;
+            typedef typename AUTOMATON::symbol symbol;
+            typedef typename AUTOMATON::rule rule;
+            typedef typename AUTOMATON::table_action table_action;
+            template <typename T>
+                struct types : AUTOMATON::template types<T>{};
+            typedef typename types<state>::vector state_stack;
+            static const size_t no_error = size_t(-1);
+
+            struct segment
+            {
+                state_stack start_stack;//empty if the segment is not parsed
+                typename types<TOKEN_TYPE>::vector tokens;
+                typename types<table_action>::vector actions;
+            };
+
+            const AUTOMATON* automaton;
+            state initial_state;
+            uint segment_size;
+            typename types<segment>::vector segments;
+            state_stack parse_stack;//after the last parsed token
+            size_t token_count;
+            size_t error_position;//of the token with no action, or no_error
+            STATS stats;
+
+            incremental_context(const AUTOMATON& automaton, state initial_state, uint segment_size = 256)
+                :automaton(&automaton), initial_state(initial_state), segment_size(segment_size)
+            {
+                clear();
+            }
+            void clear()
+            {
+                segments.assign(1, segment());
+                segments[0].start_stack.push_back(initial_state);
+                parse_stack = segments[0].start_stack;
+                token_count = 0;
+                error_position = no_error;
+            }
+            size_t size() const
+            {
+                return token_count;
+            }
+            template <typename TOKEN_ITERATOR>
+                PARSE_STATUS assign(TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                {
+                    clear();
+                    return replace(0, 0, begin, end);
+                }
+            //the parse of the tokens of an edit: new segments, cut every
+            //segment_size tokens and where cut is set. After a token with
+            //no action the rest are only collected, in unparsed segments.
+            struct reparse
+            {
+                incremental_context* owner;
+                state_stack stack;
+                typename types<segment>::vector fresh;
+                bool cut;
+                bool failed;
+                size_t error_position;
+
+                reparse(incremental_context& owner, const state_stack& stack)
+                    :owner(&owner), stack(stack), cut(false), failed(false), error_position(no_error)
+                {}
+                template <typename TOKEN_REFERENCE>
+                    void feed(TOKEN_REFERENCE&& token, size_t position)
+                    {
+                        if (failed) {
+                            if (fresh.back().tokens.size() >= owner->segment_size)
+                                fresh.push_back(segment());
+                            fresh.back().tokens.push_back(std::forward<TOKEN_REFERENCE>(token));
+                            return;
+                        }
+                        if (cut || fresh.empty() || fresh.back().tokens.size() >= owner->segment_size) {
+                            fresh.push_back(segment());
+                            fresh.back().start_stack = stack;
+                            cut = false;
+                        }
+                        if (!owner->parse_token(stack, token.get_symbol(), fresh.back().actions)) {
+                            failed = true;
+                            error_position = position;
+                            fresh.push_back(segment());
+                        }
+                        fresh.back().tokens.push_back(std::forward<TOKEN_REFERENCE>(token));
+                    }
+            };
+            //does the reductions lookup calls for and shifts it, recording
+            //the actions; false if it has no action
+            bool parse_token(state_stack& stack, const symbol& lookup, typename types<table_action>::vector& actions)
+            {
+                for (;;) {
+                    table_action needed_action = lookup_action(*automaton, stack.back(), lookup, stats);
+                    switch (needed_action.get_type()) {
+                        case SHIFT:
+                            stack.push_back(needed_action.get_value());
+                            stats.on_shift(stack.back(), stack.size());
+                            actions.push_back(needed_action);
+                            return true;
+                        case REDUCE:
+                            {
+                                const rule& reduced = automaton->get_rule(needed_action.get_value());
+                                state next = lookup_goto(*automaton, stack[stack.size() - reduced.size() - 1],
+                                        reduced.get_left_hand(), stats);
+                                if (next == AUTOMATON::invalid_state) {
+                                    //nothing to go to
+                                    stats.on_syntax_error();
+                                    return false;
+                                }
+                                stack.resize(stack.size() - reduced.size());
+                                stack.push_back(next);
+                                stats.on_reduce(needed_action.get_value(), stack.size());
+                                actions.push_back(needed_action);
+                                break;
+                            }
+                        default:
+                            stats.on_syntax_error();
+                            return false;
+                    }
+                }
+            }
+            //replaces the tokens [first, last) with [begin, end) and reparses
+            //what the edit affects; returns PARSE_FAILED if the document
+            //now has a syntax error (see error_position)
+            template <typename TOKEN_ITERATOR>
+                PARSE_STATUS replace(size_t first, size_t last, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                {
+                    if (first > last || last > token_count)
+                        throw std::runtime_error("replaced range is outside of the document");
+                    //resume at the last parsed segment starting at or before first
+                    uint resumed = 0;
+                    size_t resumed_start = 0;
+                    while (resumed + 1 < segments.size() && resumed_start + segments[resumed].tokens.size() <= first) {
+                        resumed_start += segments[resumed].tokens.size();
+                        ++resumed;
+                    }
+                    while (segments[resumed].start_stack.empty()) {
+                        --resumed;
+                        resumed_start -= segments[resumed].tokens.size();
+                    }
+                    //the old segment holding last
+                    uint tail = resumed;
+                    size_t tail_start = resumed_start;
+                    while (tail < segments.size() && tail_start + segments[tail].tokens.size() <= last) {
+                        tail_start += segments[tail].tokens.size();
+                        ++tail;
+                    }
+
+                    //segments from resumed up to the convergence point are
+                    //replaced, so their tokens can be moved
+                    reparse pass(*this, segments[resumed].start_stack);
+                    size_t position = resumed_start;
+                    for (uint i = resumed; position < first; ++i)
+                        for (uint j = 0; j < segments[i].tokens.size() && position < first; ++j, ++position)
+                            pass.feed(std::move(segments[i].tokens[j]), position);
+                    for (; begin != end; ++begin, ++position)
+                        pass.feed(*begin, position);
+                    size_t inserted = position - first;
+                    uint converged = segments.size();
+                    uint next = tail;
+                    if (tail < segments.size() && last > tail_start) {
+                        for (uint j = last - tail_start; j < segments[tail].tokens.size(); ++j, ++position)
+                            pass.feed(std::move(segments[tail].tokens[j]), position);
+                        ++next;
+                    }
+                    for (uint i = next; i < segments.size(); ++i) {
+                        if (pass.failed || (!segments[i].start_stack.empty() && pass.stack == segments[i].start_stack)) {
+                            converged = i;
+                            break;
+                        }
+                        pass.cut = true;
+                        for (uint j = 0; j < segments[i].tokens.size(); ++j, ++position)
+                            pass.feed(std::move(segments[i].tokens[j]), position);
+                    }
+
+                    token_count = token_count - (last - first) + inserted;
+                    if (pass.failed) {
+                        error_position = pass.error_position;
+                        parse_stack = pass.stack;
+                        for (uint i = converged; i < segments.size(); ++i) {
+                            segments[i].start_stack.clear();
+                            segments[i].actions.clear();
+                        }
+                    } else if (converged == segments.size()) {
+                        parse_stack = pass.stack;
+                        error_position = no_error;
+                    } else if (error_position != no_error) {
+                        error_position = error_position - (last - first) + inserted;
+                    }
+                    segments.erase(segments.begin() + resumed, segments.begin() + converged);
+                    segments.insert(segments.begin() + resumed,
+                            std::make_move_iterator(pass.fresh.begin()), std::make_move_iterator(pass.fresh.end()));
+                    if (segments.empty()) {
+                        segments.push_back(segment());
+                        segments[0].start_stack.push_back(initial_state);
+                    }
+                    return error_position == no_error ? PARSE_OK : PARSE_FAILED;
+                }
+            struct default_action
+            {
+                template <typename TOKEN_ITERATOR>
+                    TOKEN_TYPE operator()(const rule& rule, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                    {
+                        return TOKEN_TYPE(rule, begin, end);
+                    }
+            };
+            typename types<TOKEN_TYPE>::vector evaluate() const
+            {
+                return evaluate(default_action());
+            }
+            //replays the recorded actions of the parsed part of the document
+            //over copies of its tokens, running callback at each reduction;
+            //returns what the token stack of a context would hold
+            template <typename REDUCE_CALLBACK>
+                typename types<TOKEN_TYPE>::vector evaluate(REDUCE_CALLBACK callback) const
+                {
+                    typename types<TOKEN_TYPE>::vector values;
+                    for (uint i = 0; i < segments.size() && !segments[i].start_stack.empty(); ++i) {
+                        const segment& replayed = segments[i];
+                        uint next_token = 0;
+                        for (uint j = 0; j < replayed.actions.size(); ++j) {
+                            if (replayed.actions[j].get_type() == SHIFT) {
+                                values.push_back(replayed.tokens[next_token++]);
+                                continue;
+                            }
+                            const rule& reduced = automaton->get_rule(replayed.actions[j].get_value());
+                            TOKEN_TYPE value = callback(reduced, values.end() - reduced.size(), values.end());
+                            values.erase(values.end() - reduced.size(), values.end());
+                            values.push_back(std::move(value));
+                        }
+                    }
+                    return values;
+                }
+        };
+    template <typename AUTOMATON, typename TOKEN_TYPE, typename STATS>
+        const size_t incremental_context<AUTOMATON, TOKEN_TYPE, STATS>::no_error;
+}
+
+#endif
@@ -0,0 +1,597 @@
+#ifndef PARSER_LEXER_HPP
+#define PARSER_LEXER_HPP
+// vim: set cino=; set sw=4; set ts=4
+//a DFA lexer producing the symbols of a parser:
+//
+//  parser::default_lexer lexer;
+//  lexer.add("[a-zA-Z_][a-zA-Z_0-9]*", 'a');
+//  lexer.add("[0-9]+", 'n');
+//  lexer.add("\\+", '+');
+//  lexer.skip("[ \t\n]+");
+//  lexer.compile();
+//  const char* stopped = lexer.scan(begin, end, callback);//callback(symbol, begin, end)
+//  const char* kept = lexer.scan_partial(begin, end, callback, failed);//for input arriving in pieces
+//
+//The token regexes support literals, escapes (\n \t \r \d \w \s and any
+//escaped character), classes ([a-z], [^...]), ., grouping, |, *, + and ?.
+//They are compiled to one DFA that is minimized and whose columns are byte
+//classes. The longest match wins, and the earlier definition among equally
+//long ones. States that loop on themselves (identifier, digit and
+//whitespace runs) skip the run 16 bytes at a time with SSE2 when it is
+//available.
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <vector>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "parser.hpp"
+
+namespace parser {
+    namespace lexer_detail {
+        struct byte_set
+        {
+            uint32_t words[8];
+            byte_set()
+            {
+                std::fill(words, words + 8, 0u);
+            }
+            void add(unsigned int b)
+            {
+                words[b / 32] |= 1u << (b % 32);
+            }
+            void add_range(unsigned int low, unsigned int high)
+            {
+                for (unsigned int b = low; b <= high; ++b)
+                    add(b);
+            }
+            bool has(unsigned int b) const
+            {
+                return (words[b / 32] >> (b % 32)) & 1;
+            }
+            void invert()
+            {
+                for (int i = 0; i < 8; ++i)
+                    words[i] = ~words[i];
+            }
+            void merge(const byte_set& other)
+            {
+                for (int i = 0; i < 8; ++i)
+                    words[i] |= other.words[i];
+            }
+        };
+        struct nfa_state
+        {
+            byte_set on;
+            unsigned int next;//target of the byte edge, uint(-1) if none
+            std::vector<unsigned int> epsilon;
+            unsigned int accept;//token index, uint(-1) if none
+            nfa_state()
+                :next(unsigned(-1)), accept(unsigned(-1))
+            {}
+        };
+        struct fragment
+        {
+            unsigned int start, end;
+        };
+        //recursive descent over one token definition, adding its states
+        struct regex_compiler
+        {
+            std::vector<nfa_state>& states;
+            const char* p;
+
+            regex_compiler(std::vector<nfa_state>& states, const char* pattern)
+                :states(states), p(pattern)
+            {}
+            unsigned int add_state()
+            {
+                states.push_back(nfa_state());
+                return states.size() - 1;
+            }
+            fragment edge(const byte_set& on)
+            {
+                fragment rez = {add_state(), add_state()};
+                states[rez.start].on = on;
+                states[rez.start].next = rez.end;
+                return rez;
+            }
+            fragment empty()
+            {
+                fragment rez = {add_state(), 0};
+                rez.end = rez.start;
+                return rez;
+            }
+            void fail(const char* message)
+            {
+                throw std::runtime_error(message);
+            }
+            fragment alternation()
+            {
+                fragment rez = concatenation();
+                while (*p == '|') {
+                    ++p;
+                    fragment other = concatenation();
+                    fragment joined = {add_state(), add_state()};
+                    states[joined.start].epsilon.push_back(rez.start);
+                    states[joined.start].epsilon.push_back(other.start);
+                    states[rez.end].epsilon.push_back(joined.end);
+                    states[other.end].epsilon.push_back(joined.end);
+                    rez = joined;
+                }
+                return rez;
+            }
+            fragment concatenation()
+            {
+                fragment rez = empty();
+                while (*p && *p != '|' && *p != ')') {
+                    fragment next = repetition();
+                    states[rez.end].epsilon.push_back(next.start);
+                    rez.end = next.end;
+                }
+                return rez;
+            }
+            fragment repetition()
+            {
+                fragment rez = atom();
+                for (;; ++p) {
+                    if (*p != '*' && *p != '+' && *p != '?')
+                        return rez;
+                    fragment wrapped = {add_state(), add_state()};
+                    states[wrapped.start].epsilon.push_back(rez.start);
+                    if (*p != '+')
+                        states[wrapped.start].epsilon.push_back(wrapped.end);
+                    if (*p != '?')
+                        states[rez.end].epsilon.push_back(rez.start);
+                    states[rez.end].epsilon.push_back(wrapped.end);
+                    rez = wrapped;
+                }
+            }
+            //an escaped character or class after the backslash
+            byte_set escape()
+            {
+                byte_set rez;
+                char c = *p++;
+                switch (c) {
+                    case 0:
+                        fail("regex ends with a backslash");
+                        break;
+                    case 'd':
+                        rez.add_range('0', '9');
+                        break;
+                    case 'w':
+                        rez.add_range('a', 'z');
+                        rez.add_range('A', 'Z');
+                        rez.add_range('0', '9');
+                        rez.add('_');
+                        break;
+                    case 's':
+                        rez.add(' ');
+                        rez.add_range('\t', '\r');
+                        break;
+                    case 'n':
+                        rez.add('\n');
+                        break;
+                    case 't':
+                        rez.add('\t');
+                        break;
+                    case 'r':
+                        rez.add('\r');
+                        break;
+                    default:
+                        rez.add((unsigned char)c);
+                }
+                return rez;
+            }
+            byte_set character_class()
+            {
+                byte_set rez;
+                bool inverted = *p == '^';
+                if (inverted)
+                    ++p;
+                for (bool first = true; first || *p != ']'; first = false) {
+                    if (!*p)
+                        fail("unterminated character class in regex");
+                    if (*p == '\\') {
+                        ++p;
+                        rez.merge(escape());
+                        continue;
+                    }
+                    unsigned int low = (unsigned char)*p++;
+                    if (p[0] == '-' && p[1] && p[1] != ']') {
+                        unsigned int high = (unsigned char)p[1];
+                        p += 2;
+                        if (high < low)
+                            fail("inverted range in regex");
+                        rez.add_range(low, high);
+                    } else {
+                        rez.add(low);
+                    }
+                }
+                ++p;
+                if (inverted)
+                    rez.invert();
+                return rez;
+            }
+            fragment atom()
+            {
+                byte_set on;
+                switch (*p) {
+                    case '(': {
+                        ++p;
+                        fragment rez = alternation();
+                        if (*p++ != ')')
+                            fail("unbalanced parenthesis in regex");
+                        return rez;
+                    }
+                    case '[':
+                        ++p;
+                        on = character_class();
+                        break;
+                    case '.':
+                        ++p;
+                        on.add('\n');
+                        on.invert();
+                        break;
+                    case '\\':
+                        ++p;
+                        on = escape();
+                        break;
+                    case '*': case '+': case '?':
+                        fail("repetition of nothing in regex");
+                        break;
+                    default:
+                        on.add((unsigned char)*p++);
+                }
+                return edge(on);
+            }
+        };
+    }
+
+    template <typename SYMBOL>
+        class lexer
+        {
+            typedef lexer_detail::nfa_state nfa_state;
+            typedef lexer_detail::byte_set byte_set;
+            enum { NONE = ~0u, MAX_RANGES = 3 };
+
+            struct definition
+            {
+                SYMBOL s;
+                bool skipped;
+            };
+            std::vector<definition> definitions;
+            std::vector<nfa_state> nfa;
+            unsigned int nfa_start;
+
+            //the compiled DFA; state 0 is the dead state, 1 the start
+            unsigned char byte_classes[256];
+            unsigned int class_count;
+            std::vector<uint32_t> transitions;//state * class_count + class
+            std::vector<uint32_t> accepts;//definition index or NONE
+            //bytes a state loops on, as at most MAX_RANGES inclusive ranges;
+            //range_counts is 0 for states without such a loop
+            std::vector<unsigned char> range_counts;
+            std::vector<unsigned char> ranges;//state * 2 * MAX_RANGES
+
+            void add_definition(const char* regex, const SYMBOL& s, bool skipped)
+            {
+                if (nfa.empty()) {
+                    nfa.push_back(nfa_state());
+                    nfa_start = 0;
+                }
+                lexer_detail::regex_compiler compiler(nfa, regex);
+                lexer_detail::fragment rez = compiler.alternation();
+                if (*compiler.p)
+                    compiler.fail("unbalanced parenthesis in regex");
+                nfa[nfa_start].epsilon.push_back(rez.start);
+                nfa[rez.end].accept = definitions.size();
+                definition added = {s, skipped};
+                definitions.push_back(added);
+                transitions.clear();
+            }
+            void epsilon_closure(std::vector<unsigned int>& set) const
+            {
+                std::vector<unsigned int> pending(set);
+                std::vector<char> seen(nfa.size(), 0);
+                for (size_t i = 0; i < set.size(); ++i)
+                    seen[set[i]] = 1;
+                while (!pending.empty()) {
+                    unsigned int current = pending.back();
+                    pending.pop_back();
+                    for (size_t i = 0; i < nfa[current].epsilon.size(); ++i) {
+                        unsigned int target = nfa[current].epsilon[i];
+                        if (!seen[target]) {
+                            seen[target] = 1;
+                            set.push_back(target);
+                            pending.push_back(target);
+                        }
+                    }
+                }
+                std::sort(set.begin(), set.end());
+            }
+            //bytes that no edge tells apart share a class
+            void compute_byte_classes()
+            {
+                std::map<std::vector<unsigned int>, unsigned int> classes;
+                for (unsigned int b = 0; b < 256; ++b) {
+                    std::vector<unsigned int> signature;
+                    for (size_t i = 0; i < nfa.size(); ++i)
+                        if (nfa[i].next != NONE && nfa[i].on.has(b))
+                            signature.push_back(i);
+                    typename std::map<std::vector<unsigned int>, unsigned int>::iterator found = classes.find(signature);
+                    if (found == classes.end())
+                        found = classes.insert(std::make_pair(signature, unsigned(classes.size()))).first;
+                    byte_classes[b] = found->second;
+                }
+                class_count = classes.size();
+            }
+            void build_dfa(std::vector<uint32_t>& dfa, std::vector<uint32_t>& dfa_accepts) const
+            {
+                std::vector<unsigned char> representative(class_count);
+                for (unsigned int b = 256; b-- > 0; )
+                    representative[byte_classes[b]] = b;
+                std::map<std::vector<unsigned int>, unsigned int> ids;
+                std::vector<std::vector<unsigned int> > sets(2);
+                sets[1].push_back(nfa_start);
+                epsilon_closure(sets[1]);
+                ids[sets[0]] = 0;
+                ids[sets[1]] = 1;
+                dfa.assign(2 * class_count, 0);
+                for (unsigned int current = 1; current < sets.size(); ++current) {
+                    for (unsigned int c = 0; c < class_count; ++c) {
+                        std::vector<unsigned int> target;
+                        for (size_t i = 0; i < sets[current].size(); ++i) {
+                            const nfa_state& from = nfa[sets[current][i]];
+                            if (from.next != NONE && from.on.has(representative[c]))
+                                target.push_back(from.next);
+                        }
+                        epsilon_closure(target);
+                        std::map<std::vector<unsigned int>, unsigned int>::iterator found = ids.find(target);
+                        if (found == ids.end()) {
+                            found = ids.insert(std::make_pair(target, unsigned(sets.size()))).first;
+                            sets.push_back(target);
+                            dfa.resize(sets.size() * class_count, 0);
+                        }
+                        dfa[current * class_count + c] = found->second;
+                    }
+                }
+                dfa_accepts.assign(sets.size(), NONE);
+                for (size_t state = 0; state < sets.size(); ++state)
+                    for (size_t i = 0; i < sets[state].size(); ++i)
+                        dfa_accepts[state] = std::min<uint32_t>(dfa_accepts[state], nfa[sets[state][i]].accept);
+            }
+            //Moore's partition refinement; keeps the dead state 0 and the
+            //start state 1 in place
+            void minimize(const std::vector<uint32_t>& dfa, const std::vector<uint32_t>& dfa_accepts)
+            {
+                unsigned int count = dfa_accepts.size();
+                std::vector<uint32_t> block(count), next_block(count);
+                for (unsigned int state = 0; state < count; ++state)
+                    block[state] = dfa_accepts[state] == NONE ? 0 : dfa_accepts[state] + 1;
+                block[0] = NONE;//the dead state stays alone
+                for (unsigned int blocks = 0; ; ) {
+                    std::map<std::vector<uint32_t>, unsigned int> signatures;
+                    for (unsigned int state = 0; state < count; ++state) {
+                        std::vector<uint32_t> signature(1, block[state]);
+                        for (unsigned int c = 0; c < class_count; ++c)
+                            signature.push_back(block[dfa[state * class_count + c]]);
+                        typename std::map<std::vector<uint32_t>, unsigned int>::iterator found = signatures.find(signature);
+                        if (found == signatures.end())
+                            found = signatures.insert(std::make_pair(signature, unsigned(signatures.size()))).first;
+                        next_block[state] = found->second;
+                    }
+                    block.swap(next_block);
+                    if (signatures.size() == blocks)
+                        break;
+                    blocks = signatures.size();
+                }
+                //number the blocks so that dead is 0 and start is 1
+                std::vector<uint32_t> number(count, NONE);
+                unsigned int numbered = 0;
+                number[block[0]] = numbered++;
+                if (number[block[1]] == NONE)
+                    number[block[1]] = numbered++;
+                for (unsigned int state = 0; state < count; ++state)
+                    if (number[block[state]] == NONE)
+                        number[block[state]] = numbered++;
+                transitions.assign(numbered * class_count, 0);
+                accepts.assign(numbered, NONE);
+                for (unsigned int state = 0; state < count; ++state) {
+                    unsigned int id = number[block[state]];
+                    accepts[id] = dfa_accepts[state];
+                    for (unsigned int c = 0; c < class_count; ++c)
+                        transitions[id * class_count + c] = number[block[dfa[state * class_count + c]]];
+                }
+            }
+            void compute_runs()
+            {
+                unsigned int count = accepts.size();
+                range_counts.assign(count, 0);
+                ranges.assign(count * 2 * MAX_RANGES, 0);
+                for (unsigned int state = 1; state < count; ++state) {
+                    unsigned int found = 0;
+                    bool fits = true;
+                    for (unsigned int b = 0; b < 256 && fits; ++b) {
+                        if (transitions[state * class_count + byte_classes[b]] != state)
+                            continue;
+                        if (found && ranges[state * 2 * MAX_RANGES + 2 * found - 1] == b - 1) {
+                            ranges[state * 2 * MAX_RANGES + 2 * found - 1] = b;
+                        } else if (found < MAX_RANGES) {
+                            ranges[state * 2 * MAX_RANGES + 2 * found] = b;
+                            ranges[state * 2 * MAX_RANGES + 2 * found + 1] = b;
+                            ++found;
+                        } else {
+                            fits = false;
+                        }
+                    }
+                    range_counts[state] = fits ? found : 0;
+                }
+            }
+            //first byte from p on that state does not loop on
+            const char* skip_run(unsigned int state, const char* p, const char* end) const
+            {
+                const unsigned char* state_ranges = &ranges[state * 2 * MAX_RANGES];
+                unsigned int count = range_counts[state];
+#ifdef __SSE2__
+                __m128i low[MAX_RANGES], span[MAX_RANGES];
+                for (unsigned int i = 0; i < count; ++i) {
+                    low[i] = _mm_set1_epi8(char(state_ranges[2 * i]));
+                    span[i] = _mm_set1_epi8(char(state_ranges[2 * i + 1] - state_ranges[2 * i]));
+                }
+                while (end - p >= 16) {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                    __m128i inside = _mm_setzero_si128();
+                    for (unsigned int i = 0; i < count; ++i) {
+                        //byte - low <= span, unsigned
+                        __m128i offset = _mm_sub_epi8(bytes, low[i]);
+                        inside = _mm_or_si128(inside, _mm_cmpeq_epi8(_mm_max_epu8(offset, span[i]), span[i]));
+                    }
+                    unsigned int mask = _mm_movemask_epi8(inside);
+                    if (mask != 0xffff)
+                        return p + lowest_bit(~mask);
+                    p += 16;
+                }
+#endif
+                for (; p != end; ++p) {
+                    unsigned int b = (unsigned char)*p;
+                    bool inside = false;
+                    for (unsigned int i = 0; i < count; ++i)
+                        inside = inside || (b >= state_ranges[2 * i] && b <= state_ranges[2 * i + 1]);
+                    if (!inside)
+                        return p;
+                }
+                return end;
+            }
+        public:
+            typedef SYMBOL symbol;
+
+            lexer()
+                :nfa_start(0), class_count(0)
+            {}
+            //a token; earlier definitions win among matches of equal length
+            void add(const char* regex, const SYMBOL& s)
+            {
+                add_definition(regex, s, false);
+            }
+            //text that is matched and dropped, like whitespace or comments
+            void skip(const char* regex)
+            {
+                add_definition(regex, SYMBOL(), true);
+            }
+            //builds the DFA; scan calls it if the definitions changed
+            void compile()
+            {
+                if (definitions.empty())
+                    throw std::runtime_error("lexer has no tokens");
+                compute_byte_classes();
+                std::vector<uint32_t> dfa, dfa_accepts;
+                build_dfa(dfa, dfa_accepts);
+                minimize(dfa, dfa_accepts);
+                compute_runs();
+            }
+            unsigned int state_count() const
+            {
+                return accepts.size();
+            }
+            unsigned int get_class_count() const
+            {
+                return class_count;
+            }
+            //calls callback(symbol, begin, end) for every token in
+            //[begin, end); returns the position of the first byte no token
+            //matches, or end
+            template <typename CALLBACK>
+                const char* scan(const char* begin, const char* end, CALLBACK callback)
+                {
+                    if (transitions.empty())
+                        compile();
+                    return static_cast<const lexer&>(*this).scan_compiled(begin, end, callback);
+                }
+            template <typename CALLBACK>
+                const char* scan_compiled(const char* begin, const char* end, CALLBACK& callback) const
+                {
+                    bool failed;
+                    return scan_run(begin, end, callback, false, failed);
+                }
+            //scan for input that arrives in pieces: the last token is held
+            //back while more bytes could extend it. Returns the position of
+            //the bytes to keep and scan again in front of the next piece,
+            //or of the first byte no token matches, and then sets failed.
+            //The piece at the end of input goes to scan.
+            template <typename CALLBACK>
+                const char* scan_partial(const char* begin, const char* end, CALLBACK callback, bool& failed)
+                {
+                    if (transitions.empty())
+                        compile();
+                    return scan_run(begin, end, callback, true, failed);
+                }
+            template <typename CALLBACK>
+                const char* scan_run(const char* begin, const char* end, CALLBACK& callback, bool partial, bool& failed) const
+                {
+                    const uint32_t* table = &transitions[0];
+                    failed = false;
+                    while (begin != end) {
+                        unsigned int state = 1;
+                        const char* matched = 0;
+                        unsigned int token = NONE;
+                        for (const char* p = begin; p != end; ) {
+                            state = table[state * class_count + byte_classes[(unsigned char)*p++]];
+                            if (!state)
+                                break;
+                            if (range_counts[state] && p != end)
+                                p = skip_run(state, p, end);
+                            if (accepts[state] != NONE) {
+                                matched = p;
+                                token = accepts[state];
+                            }
+                        }
+                        if (partial && state)
+                            return begin;
+                        if (!matched) {
+                            failed = true;
+                            return begin;
+                        }
+                        if (!definitions[token].skipped)
+                            callback(definitions[token].s, begin, matched);
+                        begin = matched;
+                    }
+                    return end;
+                }
+        };
+
+    //a scan callback feeding TOKEN_TYPE(symbol, begin, end) to a context
+    template <typename CONTEXT, typename TOKEN_TYPE>
+        struct context_feeder
+        {
+            CONTEXT* context;
+            context_feeder(CONTEXT& context)
+                :context(&context)
+            {}
+            template <typename SYMBOL>
+                void operator()(const SYMBOL& s, const char* begin, const char* end)
+                {
+                    context->feed_symbol(TOKEN_TYPE(s, begin, end));
+                }
+        };
+    //a scan callback appending TOKEN_TYPE(symbol, begin, end) to a vector,
+    //for feed_symbols
+    template <typename VECTOR>
+        struct token_collector
+        {
+            VECTOR* tokens;
+            token_collector(VECTOR& tokens)
+                :tokens(&tokens)
+            {}
+            template <typename SYMBOL>
+                void operator()(const SYMBOL& s, const char* begin, const char* end)
+                {
+                    tokens->push_back(typename VECTOR::value_type(s, begin, end));
+                }
+        };
+
+    typedef lexer<default_parser::symbol> default_lexer;
+}
+
+#endif
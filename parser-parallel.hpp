@@ -0,0 +1,344 @@
+#ifndef PARSER_PARALLEL_HPP
+#define PARSER_PARALLEL_HPP
+// vim: set cino=; set sw=4; set ts=4
+//data-parallel parsing of a long token range into any context:
+//
+//  parser::default_parser::table_context<token> context(table);
+//  if (parser::feed_parallel(context, tokens.begin(), tokens.end(), callback) != tokens.end())
+//      ... syntax error ...
+//
+//The range is cut into one chunk per thread. The calling thread parses the
+//first chunk into the context while every other chunk is parsed
+//speculatively on a worker thread, starting from a guessed parse stack:
+//the shallowest stack that recurs while probing the first tokens, such as
+//the stack between two elements of a top-level list. Chunks start after a
+//token of the symbol shifted to reach it, at the first such token from
+//which a states-only parse comes back to the guess.
+//
+//A worker runs the reduce callbacks of every reduction that stays within
+//its own tokens. A reduction that reaches below them, into the guessed
+//stack, needs values of the chunks before it; it is recorded in a log
+//together with the values it takes and leaves a pending entry, and so are
+//the reductions taking pending entries. Chunks are then stitched in order:
+//if the real stack agrees with the guess as deep as the worker looked into
+//it, the log is replayed on the context's stacks (for list-like inputs,
+//one callback per top-level element) and the worker's stack is put on top.
+//Otherwise the chunk is fed again from the real stack. Callbacks of
+//discarded chunks have run for nothing, so they should not have side
+//effects beyond their result; workers copy their tokens and report no
+//statistics. A chunk whose worker throws is fed again from the real
+//stack, so exceptions reach the caller as they would in a sequential parse.
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <utility>
+#include "parser.hpp"
+
+namespace parser {
+    template <typename CONTEXT, typename TOKEN_ITERATOR, typename REDUCE_CALLBACK>
+        struct speculative_chunk
+        {
+            typedef typename CONTEXT::automaton_type automaton_type;
+            typedef typename CONTEXT::token_type token_type;
+            typedef typename automaton_type::uint uint;
+            typedef typename automaton_type::state state;
+            typedef typename automaton_type::symbol symbol;
+            typedef typename automaton_type::rule rule;
+            typedef typename automaton_type::table_action table_action;
+            template <typename T>
+                struct types : automaton_type::template types<T>{};
+            typedef typename types<state>::vector state_stack;
+            enum { PUSH_VALUE = uint(-1) };
+
+            const automaton_type* automaton;
+            const state_stack* guess;
+            TOKEN_ITERATOR begin, end;
+            REDUCE_CALLBACK callback;
+
+            uint guess_top;//entries of the guess not popped
+            uint read_depth;//entries of the guess, from the top, whose state was looked at
+            state_stack own;
+            uint first_computed;//own entries below are pending
+            typename types<token_type>::vector values;//of own[first_computed...]
+            typename types<uint>::vector log;//rule indices and PUSH_VALUE
+            typename types<token_type>::vector log_values;
+            bool failed;
+
+            speculative_chunk(const automaton_type& automaton, const state_stack& guess, TOKEN_ITERATOR begin, TOKEN_ITERATOR end,
+                    const REDUCE_CALLBACK& callback)
+                :automaton(&automaton), guess(&guess), begin(begin), end(end), callback(callback),
+                guess_top(guess.size()), read_depth(0), first_computed(0), failed(false)
+            {}
+            state top_state()
+            {
+                if (!own.empty())
+                    return own.back();
+                read_depth = std::max<uint>(read_depth, guess->size() - guess_top + 1);
+                return (*guess)[guess_top - 1];
+            }
+            void operator()()
+            {
+                try {
+                    no_stats stats;
+                    for (TOKEN_ITERATOR it = begin; it != end; ++it) {
+                        for (;;) {
+                            table_action needed_action = lookup_action(*automaton, top_state(), it->get_symbol(), stats);
+                            if (needed_action.get_type() == SHIFT) {
+                                own.push_back(needed_action.get_value());
+                                values.push_back(*it);
+                                break;
+                            }
+                            if (needed_action.get_type() != REDUCE || !reduce(needed_action.get_value(), stats)) {
+                                failed = true;
+                                return;
+                            }
+                        }
+                    }
+                } catch (...) {
+                    //the sequential parse of the chunk throws it again if
+                    //the chunk is reached
+                    failed = true;
+                }
+            }
+            bool reduce(uint rule_index, no_stats& stats)
+            {
+                const rule& reduced = automaton->get_rule(rule_index);
+                uint size = reduced.size();
+                if (size <= values.size()) {
+                    own.resize(own.size() - size);
+                    state next = lookup_goto(*automaton, top_state(), reduced.get_left_hand(), stats);
+                    if (next == automaton_type::invalid_state)
+                        return false;
+                    own.push_back(next);
+                    token_type value = callback(reduced, values.end() - size, values.end());
+                    values.erase(values.end() - size, values.end());
+                    values.push_back(std::move(value));
+                    return true;
+                }
+                //the right hand side takes pending entries or the guess
+                if (size > own.size() + guess_top - 1)
+                    return false;
+                for (uint i = 0; i < values.size(); ++i) {
+                    log.push_back(PUSH_VALUE);
+                    log_values.push_back(std::move(values[i]));
+                }
+                log.push_back(rule_index);
+                values.clear();
+                if (size > own.size()) {
+                    guess_top -= size - own.size();
+                    own.clear();
+                } else {
+                    own.resize(own.size() - size);
+                }
+                state next = lookup_goto(*automaton, top_state(), reduced.get_left_hand(), stats);
+                if (next == automaton_type::invalid_state)
+                    return false;
+                own.push_back(next);
+                first_computed = own.size();
+                return true;
+            }
+            //whether the guess agrees with the real stack where it was looked at
+            template <typename STACK>
+                bool holds(const STACK& real) const
+                {
+                    if (failed || real.size() < read_depth)
+                        return false;
+                    for (uint i = 1; i <= read_depth; ++i)
+                        if (real[real.size() - i] != (*guess)[guess->size() - i])
+                            return false;
+                    return true;
+                }
+            //replays the log on the context and puts the worker's stack on top
+            void stitch(CONTEXT& context, REDUCE_CALLBACK& context_callback)
+            {
+                uint next_value = 0;
+                for (uint i = 0; i < log.size(); ++i) {
+                    if (log[i] == PUSH_VALUE) {
+                        context.token_stack.push_back(std::move(log_values[next_value++]));
+                        continue;
+                    }
+                    const rule& reduced = automaton->get_rule(log[i]);
+                    uint size = reduced.size();
+                    token_type value = context_callback(reduced, context.token_stack.end() - size, context.token_stack.end());
+                    context.stats.on_value();
+                    context.stats.on_reduce(log[i], context.token_stack.size() + 1);
+                    if (size) {
+                        *(context.token_stack.end() - size) = std::move(value);
+                        context.token_stack.pop(size - 1);
+                    } else {
+                        context.token_stack.push_back(std::move(value));
+                    }
+                }
+                context.parse_stack.pop(guess->size() - guess_top);
+                for (uint i = 0; i < own.size(); ++i)
+                    context.parse_stack.push_back(own[i]);
+                for (uint i = 0; i < values.size(); ++i)
+                    context.token_stack.push_back(std::move(values[i]));
+            }
+        };
+
+    //a parse that keeps state ids only, for choosing where and from which
+    //stack the chunks are parsed
+    template <typename AUTOMATON>
+        struct state_probe
+        {
+            typedef typename AUTOMATON::state state;
+            typedef typename AUTOMATON::symbol symbol;
+            typedef typename AUTOMATON::rule rule;
+            typedef typename AUTOMATON::table_action table_action;
+            typedef typename AUTOMATON::template types<state>::vector state_stack;
+
+            const AUTOMATON* automaton;
+            state_stack stack;
+            no_stats stats;
+
+            state_probe(const AUTOMATON& automaton, const state_stack& stack)
+                :automaton(&automaton), stack(stack)
+            {}
+            //false if lookup has no action
+            bool feed(const symbol& lookup)
+            {
+                for (;;) {
+                    table_action needed_action = lookup_action(*automaton, stack.back(), lookup, stats);
+                    if (needed_action.get_type() == SHIFT) {
+                        stack.push_back(needed_action.get_value());
+                        return true;
+                    }
+                    if (needed_action.get_type() != REDUCE)
+                        return false;
+                    const rule& reduced = automaton->get_rule(needed_action.get_value());
+                    if (reduced.size() >= stack.size())
+                        return false;
+                    stack.resize(stack.size() - reduced.size());
+                    state next = lookup_goto(*automaton, stack.back(), reduced.get_left_hand(), stats);
+                    if (next == AUTOMATON::invalid_state)
+                        return false;
+                    stack.push_back(next);
+                }
+            }
+        };
+
+    template <typename CONTEXT, typename TOKEN_ITERATOR, typename REDUCE_CALLBACK>
+        TOKEN_ITERATOR feed_parallel(CONTEXT& context, TOKEN_ITERATOR begin, TOKEN_ITERATOR end, REDUCE_CALLBACK callback,
+                unsigned int thread_count = 0)
+        {
+            typedef speculative_chunk<CONTEXT, TOKEN_ITERATOR, REDUCE_CALLBACK> chunk;
+            typedef typename chunk::uint uint;
+            typedef typename chunk::state state;
+            typedef typename chunk::symbol symbol;
+            typedef state_probe<typename chunk::automaton_type> probe_type;
+            enum { MIN_CHUNK_SIZE = 4096, PROBE_SIZE = 4096 };
+            if (!thread_count)
+                thread_count = std::max(1u, std::thread::hardware_concurrency());
+            size_t total = end - begin;
+            thread_count = std::min<size_t>(thread_count, total / MIN_CHUNK_SIZE);
+            if (thread_count < 2)
+                return context.feed_symbols(begin, end, callback);
+            size_t chunk_size = total / thread_count;
+
+            //the guess: the shallowest stack that recurs while probing the
+            //first tokens (the stack before the first token never does), and
+            //the symbol shifted to reach it. Stacks are told apart by their
+            //depth and top state.
+            typename chunk::state_stack start(context.parse_stack.begin(), context.parse_stack.end());
+            typename chunk::template types<std::pair<uint, state> >::vector shifts;
+            TOKEN_ITERATOR probe_end = begin + std::min<size_t>(PROBE_SIZE, chunk_size);
+            {
+                probe_type probe(*context.automaton, start);
+                for (TOKEN_ITERATOR it = begin; it != probe_end && probe.feed(it->get_symbol()); ++it)
+                    shifts.push_back(std::make_pair(uint(probe.stack.size()), probe.stack.back()));
+            }
+            typename chunk::template types<std::pair<uint, state> >::vector sorted(shifts);
+            std::sort(sorted.begin(), sorted.end());
+            uint recurring = 1;
+            while (recurring < sorted.size() && sorted[recurring] != sorted[recurring - 1])
+                ++recurring;
+            if (recurring >= sorted.size())
+                return context.feed_symbols(begin, end, callback);
+            probe_type probe(*context.automaton, start);
+            TOKEN_ITERATOR it = begin;
+            for (uint i = 0; shifts[i] != sorted[recurring]; ++i)
+                probe.feed((it++)->get_symbol());
+            probe.feed(it->get_symbol());
+            typename chunk::state_stack guess(probe.stack);
+            symbol sync = it->get_symbol();
+
+            //chunk k starts after a sync token past k * chunk_size from which
+            //the guess comes back after a later sync token, as it would after
+            //each element of a list; failing that, at k * chunk_size
+            typename chunk::template types<TOKEN_ITERATOR>::vector bounds;
+            bounds.push_back(begin);
+            for (uint k = 1; k < thread_count; ++k) {
+                TOKEN_ITERATOR nominal = begin + k * chunk_size;
+                TOKEN_ITERATOR limit = begin + std::min<size_t>(total, k * chunk_size + chunk_size / 4);
+                TOKEN_ITERATOR bound = nominal;
+                size_t budget = 4 * PROBE_SIZE;
+                for (it = nominal; it != limit && budget; ++it) {
+                    if (it->get_symbol() != sync)
+                        continue;
+                    probe = probe_type(*context.automaton, guess);
+                    TOKEN_ITERATOR checked = it + 1;
+                    for (; checked != limit && budget; ++checked, --budget) {
+                        if (!probe.feed(checked->get_symbol()))
+                            break;
+                        if (checked->get_symbol() == sync && probe.stack == guess)
+                            break;
+                    }
+                    if (checked != limit && budget && checked->get_symbol() == sync && probe.stack == guess) {
+                        bound = it + 1;
+                        break;
+                    }
+                }
+                bounds.push_back(bound);
+            }
+            bounds.push_back(end);
+
+            //chunks[k] is chunk k + 1; the workers refer to them, so they
+            //are all made before the first thread starts
+            typename chunk::template types<chunk>::vector chunks;
+            chunks.reserve(thread_count - 1);
+            for (uint k = 1; k < thread_count; ++k)
+                chunks.push_back(chunk(*context.automaton, guess, bounds[k], bounds[k + 1], callback));
+            typename chunk::template types<std::thread>::vector workers;
+            uint started = 0;
+            try {
+                workers.reserve(chunks.size());
+                for (; started < chunks.size(); ++started)
+                    workers.push_back(std::thread(std::ref(chunks[started])));
+            } catch (...) {
+                //chunks without a thread are fed from the real stack
+                for (uint k = started; k < chunks.size(); ++k)
+                    chunks[k].failed = true;
+            }
+            //the workers are joined before any exception leaves
+            TOKEN_ITERATOR stopped;
+            try {
+                stopped = context.feed_symbols(bounds[0], bounds[1], callback);
+            } catch (...) {
+                for (uint i = 0; i < workers.size(); ++i)
+                    workers[i].join();
+                throw;
+            }
+            for (uint i = 0; i < workers.size(); ++i)
+                workers[i].join();
+            if (stopped != bounds[1])
+                return stopped;
+            for (uint k = 1; k < thread_count; ++k) {
+                if (chunks[k - 1].holds(context.parse_stack)) {
+                    chunks[k - 1].stitch(context, callback);
+                    continue;
+                }
+                stopped = context.feed_symbols(bounds[k], bounds[k + 1], callback);
+                if (stopped != bounds[k + 1])
+                    return stopped;
+            }
+            return end;
+        }
+    template <typename CONTEXT, typename TOKEN_ITERATOR>
+        TOKEN_ITERATOR feed_parallel(CONTEXT& context, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+        {
+            return feed_parallel(context, begin, end, typename CONTEXT::default_action());
+        }
+}
+
+#endif
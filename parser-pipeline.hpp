@@ -0,0 +1,371 @@
+#ifndef PARSER_PIPELINE_HPP
+#define PARSER_PIPELINE_HPP
+// vim: set cino=; set sw=4; set ts=4
+//lexing and parsing a file on two threads:
+//
+//  parser::default_parser::table_context<token> context(table);
+//  parser::pipeline_result result = parser::parse_file("input.log", lexer, context, callback);
+//  if (result.error_offset != parser::pipeline_result::no_error)
+//      ... lexical (result.lexical) or syntax error at that byte ...
+//
+//A worker thread scans the input in slices with lexer::scan_partial and
+//puts TOKEN_TYPE(symbol, begin, end) with its byte offset into a fixed
+//ring. The calling thread takes whatever the ring holds in one go and
+//hands it to the context's feed_symbols, so reduce callbacks run on the
+//calling thread. When the ring is full the lexer waits, and when it is
+//empty the parser does: memory stays bounded by the ring and the slice
+//whatever the size of the input. On a syntax error the lexer is stopped.
+//An exception on either thread, from a reduce callback or from making a
+//token, stops both and is rethrown once the lexer thread is joined.
+//
+//parse_file maps regular files and reads anything else (pipes, sockets)
+//into a buffer it reuses, as parse_descriptor does. Token text is only valid during the call, and
+//with read input only until the token is made, so tokens that keep their
+//text copy it.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "parser.hpp"
+
+namespace parser {
+    struct pipeline_result
+    {
+        static const size_t no_error = size_t(-1);
+
+        size_t tokens;//parsed
+        size_t error_offset;//of the byte no token matches or the token with no action, or no_error
+        bool lexical;//whether the error is a lexical one
+    };
+
+    //a ring of tokens and their offsets between one producer thread and
+    //one consumer thread. Each side keeps its own position and publishes
+    //it with one atomic store per batch; the two positions are on separate
+    //cache lines.
+    template <typename TOKEN_TYPE>
+        struct spsc_ring
+        {
+            enum { BATCH = 64, SPINS = 64 };
+
+            std::vector<TOKEN_TYPE> tokens;
+            std::vector<size_t> offsets;
+            size_t mask;
+            alignas(64) std::atomic<size_t> head;//next slot the producer fills
+            std::atomic<bool> closed;//no more tokens come
+            alignas(64) std::atomic<size_t> tail;//next slot the consumer takes
+            std::atomic<bool> cancelled;//the consumer takes no more
+            alignas(64) size_t written;//producer's own head
+            size_t seen_tail;//producer's last look at tail
+
+            //capacity is rounded up to a power of two
+            explicit spsc_ring(size_t capacity)
+                :head(0), closed(false), tail(0), cancelled(false), written(0), seen_tail(0)
+            {
+                size_t size = 1;
+                while (size < capacity)
+                    size *= 2;
+                tokens.resize(size);
+                offsets.resize(size);
+                mask = size - 1;
+            }
+            static void pause(unsigned int& spins)
+            {
+                if (++spins > SPINS)
+                    std::this_thread::yield();
+            }
+            //producer side; false once the consumer has cancelled
+            bool push(TOKEN_TYPE&& token, size_t offset)
+            {
+                if (written - seen_tail == tokens.size()) {
+                    head.store(written, std::memory_order_release);
+                    unsigned int spins = 0;
+                    while (written - (seen_tail = tail.load(std::memory_order_acquire)) == tokens.size()) {
+                        if (cancelled.load(std::memory_order_relaxed))
+                            return false;
+                        pause(spins);
+                    }
+                }
+                tokens[written & mask] = std::move(token);
+                offsets[written & mask] = offset;
+                if (!(++written % BATCH)) {
+                    head.store(written, std::memory_order_release);
+                    //a consumer that stopped is noticed before the ring fills
+                    if (cancelled.load(std::memory_order_relaxed))
+                        return false;
+                }
+                return true;
+            }
+            void close()
+            {
+                head.store(written, std::memory_order_release);
+                closed.store(true, std::memory_order_release);
+            }
+            //consumer side: the number of tokens from slot tail & mask on
+            //that can be taken without wrapping, 0 once the ring is closed
+            //and empty
+            size_t wait_available()
+            {
+                unsigned int spins = 0;
+                for (;;) {
+                    size_t taken = tail.load(std::memory_order_relaxed);
+                    bool was_closed = closed.load(std::memory_order_acquire);
+                    size_t available = head.load(std::memory_order_acquire) - taken;
+                    if (available)
+                        return std::min(available, tokens.size() - (taken & mask));
+                    if (was_closed)
+                        return 0;
+                    pause(spins);
+                }
+            }
+            void release(size_t count)
+            {
+                tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+            }
+        };
+
+    //the producer: scans slices of text and pushes the tokens
+    template <typename LEXER, typename TOKEN_TYPE>
+        struct pipeline_lexer
+        {
+            enum { SLICE = 1 << 20 };
+
+            LEXER* lexer;
+            spsc_ring<TOKEN_TYPE>* ring;
+            const char* base;//of the offsets
+            size_t base_offset;
+            size_t error_offset;//of the first byte no token matches
+            bool stopped;
+            bool read_failed;
+            std::exception_ptr failure;//thrown while lexing
+
+            pipeline_lexer(LEXER& lexer, spsc_ring<TOKEN_TYPE>& ring)
+                :lexer(&lexer), ring(&ring), base(0), base_offset(0), error_offset(pipeline_result::no_error),
+                stopped(false), read_failed(false)
+            {}
+            //the scan callback; scans take it by value
+            struct pusher
+            {
+                pipeline_lexer* owner;
+                template <typename SYMBOL>
+                    void operator()(const SYMBOL& s, const char* begin, const char* end)
+                    {
+                        if (!owner->stopped && !owner->ring->push(TOKEN_TYPE(s, begin, end), owner->base_offset + (begin - owner->base)))
+                            owner->stopped = true;
+                    }
+            };
+            //scans [begin, end) of text at offset; unless last is set, a
+            //token that more text could extend is left. Returns where the
+            //scan stopped.
+            const char* scan(const char* begin, const char* end, size_t offset, bool last)
+            {
+                base = begin;
+                base_offset = offset;
+                pusher callback = {this};
+                const char* stopped_at;
+                bool failed = false;
+                if (last) {
+                    stopped_at = lexer->scan(begin, end, callback);
+                    failed = stopped_at != end;
+                } else {
+                    stopped_at = lexer->scan_partial(begin, end, callback, failed);
+                }
+                if (failed) {
+                    error_offset = offset + (stopped_at - begin);
+                    stopped = true;
+                }
+                return stopped_at;
+            }
+            //scans text in memory, a slice at a time
+            void scan_memory(const char* begin, const char* end)
+            {
+                try {
+                    const char* text = begin;
+                    size_t slice = SLICE;
+                    while (!stopped && text != end) {
+                        const char* slice_end = size_t(end - text) > slice ? text + slice : end;
+                        const char* kept = scan(text, slice_end, text - begin, slice_end == end);
+                        //a token longer than the slice
+                        slice = kept == text ? 2 * slice : size_t(SLICE);
+                        text = kept;
+                    }
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+                ring->close();
+            }
+#ifndef _WIN32
+            //reads a file descriptor into a buffer it reuses
+            void scan_descriptor(int fd)
+            {
+                try {
+                    std::vector<char> buffer(SLICE);
+                    size_t kept = 0;//bytes left by the last scan, at the start of buffer
+                    size_t offset = 0;//of buffer[0] in the input
+                    while (!stopped) {
+                        if (kept == buffer.size())
+                            buffer.resize(2 * buffer.size());
+                        ssize_t count = read(fd, &buffer[kept], buffer.size() - kept);
+                        if (count < 0 && errno == EINTR)
+                            continue;
+                        if (count < 0) {
+                            read_failed = true;
+                            break;
+                        }
+                        size_t filled = kept + count;
+                        const char* begin = &buffer[0];
+                        const char* stopped_at = scan(begin, begin + filled, offset, !count);
+                        if (!count)
+                            break;
+                        kept = begin + filled - stopped_at;
+                        offset += stopped_at - begin;
+                        std::copy(stopped_at, begin + filled, buffer.begin());
+                    }
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+                ring->close();
+            }
+#endif
+        };
+
+    //the consumer: feeds what the ring holds to the context
+    template <typename CONTEXT, typename REDUCE_CALLBACK>
+        pipeline_result feed_pipelined(spsc_ring<typename CONTEXT::token_type>& ring, CONTEXT& context, REDUCE_CALLBACK& callback)
+        {
+            typedef typename CONTEXT::token_type token_type;
+            pipeline_result result = {0, pipeline_result::no_error, false};
+            while (size_t available = ring.wait_available()) {
+                size_t first = ring.tail.load(std::memory_order_relaxed) & ring.mask;
+                token_type* begin = &ring.tokens[first];
+                token_type* stopped = context.feed_symbols(begin, begin + available, callback);
+                result.tokens += stopped - begin;
+                if (stopped != begin + available) {
+                    result.error_offset = ring.offsets[first + (stopped - begin)];
+                    ring.cancelled.store(true, std::memory_order_relaxed);
+                    ring.release(stopped - begin);
+                    return result;
+                }
+                ring.release(available);
+            }
+            return result;
+        }
+
+    //runs the lexer over [begin, end), or over fd if it is not -1, on a
+    //worker thread and the parser on this one
+    template <typename LEXER, typename CONTEXT, typename REDUCE_CALLBACK>
+        pipeline_result run_pipeline(LEXER& lexer, const char* begin, const char* end, int fd, CONTEXT& context,
+                REDUCE_CALLBACK& callback, size_t ring_size, bool& read_failed)
+        {
+            typedef typename CONTEXT::token_type token_type;
+            typedef pipeline_lexer<LEXER, token_type> producer_type;
+            spsc_ring<token_type> ring(ring_size);
+            producer_type producer(lexer, ring);
+            std::thread worker;
+#ifndef _WIN32
+            if (fd != -1)
+                worker = std::thread(&producer_type::scan_descriptor, &producer, fd);
+            else
+#endif
+                worker = std::thread(&producer_type::scan_memory, &producer, begin, end);
+            pipeline_result result;
+            try {
+                result = feed_pipelined(ring, context, callback);
+            } catch (...) {
+                //a full ring no longer holds the lexer once it is cancelled
+                ring.cancelled.store(true, std::memory_order_relaxed);
+                worker.join();
+                throw;
+            }
+            worker.join();
+            if (producer.failure)
+                std::rethrow_exception(producer.failure);
+            read_failed = producer.read_failed;
+            if (result.error_offset == pipeline_result::no_error && producer.error_offset != pipeline_result::no_error) {
+                result.error_offset = producer.error_offset;
+                result.lexical = true;
+            }
+            return result;
+        }
+
+    //lexes and parses text in memory on two threads; ring_size bounds the
+    //tokens in flight
+    template <typename LEXER, typename CONTEXT, typename REDUCE_CALLBACK>
+        pipeline_result parse_pipelined(LEXER& lexer, const char* begin, const char* end, CONTEXT& context,
+                REDUCE_CALLBACK callback, size_t ring_size = 1 << 14)
+        {
+            bool read_failed;
+            return run_pipeline(lexer, begin, end, -1, context, callback, ring_size, read_failed);
+        }
+    template <typename LEXER, typename CONTEXT>
+        pipeline_result parse_pipelined(LEXER& lexer, const char* begin, const char* end, CONTEXT& context)
+        {
+            return parse_pipelined(lexer, begin, end, context, typename CONTEXT::default_action());
+        }
+
+#ifndef _WIN32
+    //lexes and parses what can be read from fd on two threads, through a
+    //buffer of about a slice: memory stays bounded however long the input.
+    //Throws std::runtime_error if fd cannot be read.
+    template <typename LEXER, typename CONTEXT, typename REDUCE_CALLBACK>
+        pipeline_result parse_descriptor(int fd, LEXER& lexer, CONTEXT& context, REDUCE_CALLBACK callback,
+                size_t ring_size = 1 << 14)
+        {
+            bool read_failed;
+            pipeline_result result = run_pipeline(lexer, 0, 0, fd, context, callback, ring_size, read_failed);
+            if (read_failed)
+                throw std::runtime_error("cannot read the input file");
+            return result;
+        }
+    //the same for a file, which is mapped if it is a regular one. Mapped
+    //pages count towards the resident size until the kernel drops them;
+    //parse_descriptor keeps a strict bound instead.
+    template <typename LEXER, typename CONTEXT, typename REDUCE_CALLBACK>
+        pipeline_result parse_file(const char* path, LEXER& lexer, CONTEXT& context, REDUCE_CALLBACK callback,
+                size_t ring_size = 1 << 14)
+        {
+            int fd = open(path, O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("cannot open the input file");
+            struct stat info;
+            void* data = MAP_FAILED;
+            size_t size = 0;
+            if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+                size = info.st_size;
+                data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED)
+                    madvise(data, size, MADV_SEQUENTIAL);
+            }
+            bool read_failed;
+            pipeline_result result;
+            if (data != MAP_FAILED) {
+                const char* text = static_cast<const char*>(data);
+                result = run_pipeline(lexer, text, text + size, -1, context, callback, ring_size, read_failed);
+                munmap(data, size);
+            } else {
+                result = run_pipeline(lexer, 0, 0, fd, context, callback, ring_size, read_failed);
+            }
+            close(fd);
+            if (read_failed)
+                throw std::runtime_error("cannot read the input file");
+            return result;
+        }
+    template <typename LEXER, typename CONTEXT>
+        pipeline_result parse_file(const char* path, LEXER& lexer, CONTEXT& context)
+        {
+            return parse_file(path, lexer, context, typename CONTEXT::default_action());
+        }
+#endif
+}
+
+#endif
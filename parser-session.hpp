@@ -0,0 +1,318 @@
+#ifndef PARSER_SESSION_HPP
+#define PARSER_SESSION_HPP
+// vim: set cino=; set sw=4; set ts=4
+//small parse contexts for many concurrent push parses:
+//
+//  parser::session_pool<parser::default_parser::parse_table, token> pool(table, table.get_initial_state());
+//  parser::parse_session<parser::default_parser::parse_table, token> session(pool);
+//  session.try_feed_symbol(next_token);
+//  parser::parse_session<parser::default_parser::parse_table, token> other = session;//fork
+//
+//A session is a pool pointer, the index of its top stack node and its
+//depth: 16 bytes on 64-bit targets. The stacks of all sessions of a pool
+//live in the pool's node array as linked nodes (state id, value, parent),
+//so stacks share their common bottom. Copying a session forks it in O(1) by taking
+//a reference to its top node. A reduction copies the right hand side
+//values out of nodes still shared with another session and moves them out
+//of the others. Freed nodes go to a free list, so reset and new sessions
+//reuse the pool's storage.
+//
+//Sessions are pushed one token at a time and keep nothing else between
+//tokens, so a session can sit idle while its connection waits for bytes;
+//lexer::scan_partial holds back a token that more bytes could extend.
+//
+//A pool and its sessions belong to one thread. TOKEN_TYPE must be default
+//constructible and copyable, and reduce callbacks must not feed sessions
+//of the same pool.
+#include <stdexcept>
+#include <utility>
+#include "parser.hpp"
+
+namespace parser {
+    template <typename AUTOMATON, typename TOKEN_TYPE, typename STATS = no_stats>
+        struct session_pool
+        {
+            typedef typename AUTOMATON::uint uint;
+            typedef typename AUTOMATON::state state;
+            template <typename T>
+                struct types : AUTOMATON::template types<T>{};
+            static const uint root = 0;//the initial state, never freed
+            static const uint none = uint(-1);
+
+            struct node
+            {
+                state s;
+                uint parent;//the next free node on the free list
+                uint references;
+                TOKEN_TYPE value;
+            };
+
+            const AUTOMATON* automaton;
+            typename types<node>::vector nodes;
+            uint free_nodes;
+            typename types<TOKEN_TYPE>::vector right_hand;//of the reduction being done
+            STATS stats;
+
+            session_pool(const AUTOMATON& automaton, state initial_state)
+                :automaton(&automaton), free_nodes(none)
+            {
+                node bottom;
+                bottom.s = initial_state;
+                bottom.parent = none;
+                bottom.references = 1;
+                nodes.push_back(bottom);
+            }
+            //makes room for this many nodes, so that sessions do not allocate
+            void reserve(uint count)
+            {
+                nodes.reserve(count);
+            }
+            //a node on top of parent, taking over a reference to parent
+            uint push(state s, uint parent, TOKEN_TYPE&& value)
+            {
+                uint pushed = free_nodes;
+                if (pushed == none) {
+                    pushed = nodes.size();
+                    nodes.push_back(node());
+                } else {
+                    free_nodes = nodes[pushed].parent;
+                }
+                node& created = nodes[pushed];
+                created.s = s;
+                created.parent = parent;
+                created.references = 1;
+                created.value = std::move(value);
+                return pushed;
+            }
+            void acquire(uint n)
+            {
+                ++nodes[n].references;
+            }
+            //drops a reference, freeing the nodes no session reaches any more
+            void release(uint n)
+            {
+                while (n != root && !--nodes[n].references) {
+                    node& freed = nodes[n];
+                    uint parent = freed.parent;
+                    freed.value = TOKEN_TYPE();
+                    freed.parent = free_nodes;
+                    free_nodes = n;
+                    n = parent;
+                }
+            }
+            //nodes in use, by all sessions
+            uint size() const
+            {
+                uint free_count = 0;
+                for (uint n = free_nodes; n != none; n = nodes[n].parent)
+                    ++free_count;
+                return nodes.size() - free_count;
+            }
+        };
+    template <typename AUTOMATON, typename TOKEN_TYPE, typename STATS>
+        const typename session_pool<AUTOMATON, TOKEN_TYPE, STATS>::uint session_pool<AUTOMATON, TOKEN_TYPE, STATS>::root;
+    template <typename AUTOMATON, typename TOKEN_TYPE, typename STATS>
+        const typename session_pool<AUTOMATON, TOKEN_TYPE, STATS>::uint session_pool<AUTOMATON, TOKEN_TYPE, STATS>::none;
+
+    template <typename AUTOMATON, typename TOKEN_TYPE, typename STATS = no_stats>
+        struct parse_session
+        {
+            typedef session_pool<AUTOMATON, TOKEN_TYPE, STATS> pool_type;
+            typedef typename AUTOMATON::uint uint;
+            typedef typename AUTOMATON::state state;
+            typedef typename AUTOMATON::symbol symbol;
+            typedef typename AUTOMATON::rule rule;
+            typedef typename AUTOMATON::table_action table_action;
+
+            pool_type* pool;
+            uint top;
+            uint stack_depth;
+
+            parse_session(pool_type& pool)
+                :pool(&pool), top(pool_type::root), stack_depth(0)
+            {}
+            parse_session(const parse_session& forked)
+                :pool(forked.pool), top(forked.top), stack_depth(forked.stack_depth)
+            {
+                pool->acquire(top);
+            }
+            parse_session& operator=(const parse_session& forked)
+            {
+                forked.pool->acquire(forked.top);
+                pool->release(top);
+                pool = forked.pool;
+                top = forked.top;
+                stack_depth = forked.stack_depth;
+                return *this;
+            }
+            ~parse_session()
+            {
+                pool->release(top);
+            }
+            //back to the initial state; the nodes go back to the pool
+            void reset()
+            {
+                pool->release(top);
+                top = pool_type::root;
+                stack_depth = 0;
+            }
+            parse_session fork() const
+            {
+                return *this;
+            }
+            state top_state() const
+            {
+                return pool->nodes[top].s;
+            }
+            //the value on top of the stack, such as the start symbol's
+            //once the end of input is shifted and reduced
+            const TOKEN_TYPE& back() const
+            {
+                return pool->nodes[top].value;
+            }
+            //values on the stack, the initial state excluded
+            uint depth() const
+            {
+                return stack_depth;
+            }
+            struct default_action
+            {
+                template <typename TOKEN_ITERATOR>
+                    TOKEN_TYPE operator()(const rule& rule, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                    {
+                        return TOKEN_TYPE(rule, begin, end);
+                    }
+            };
+            void feed_symbol(TOKEN_TYPE lookup_token)
+            {
+                default_action callback;
+                if (try_feed(lookup_token, callback) != PARSE_OK)
+                    throw std::runtime_error("syntax error");
+            }
+            template <typename REDUCE_CALLBACK>
+                void feed_symbol(TOKEN_TYPE lookup_token, REDUCE_CALLBACK callback)
+                {
+                    if (try_feed(lookup_token, callback) != PARSE_OK)
+                        throw std::runtime_error("syntax error");
+                }
+            PARSE_STATUS try_feed_symbol(TOKEN_TYPE lookup_token)
+            {
+                default_action callback;
+                return try_feed(lookup_token, callback);
+            }
+            template <typename REDUCE_CALLBACK>
+                PARSE_STATUS try_feed_symbol(TOKEN_TYPE lookup_token, REDUCE_CALLBACK callback)
+                {
+                    return try_feed(lookup_token, callback);
+                }
+            //returns PARSE_FAILED if the token has no action; the session
+            //then holds the reductions done before that was found out
+            template <typename REDUCE_CALLBACK>
+                PARSE_STATUS try_feed(TOKEN_TYPE& lookup_token, REDUCE_CALLBACK& callback)
+                {
+                    const symbol lookup = lookup_token.get_symbol();
+                    for (;;) {
+                        table_action needed_action = lookup_action(*pool->automaton, top_state(), lookup, pool->stats);
+                        switch (needed_action.get_type()) {
+                            case SHIFT:
+                                top = pool->push(needed_action.get_value(), top, std::move(lookup_token));
+                                pool->stats.on_shift(top_state(), ++stack_depth);
+                                return PARSE_OK;
+                            case REDUCE:
+                                if (reduce(needed_action.get_value(), callback))
+                                    break;
+                                //nothing to go to
+                                pool->stats.on_syntax_error();
+                                return PARSE_FAILED;
+                            default:
+                                pool->stats.on_syntax_error();
+                                return PARSE_FAILED;
+                        }
+                    }
+                }
+            //feeds tokens until one has no action and returns its position,
+            //or end
+            template <typename TOKEN_ITERATOR, typename REDUCE_CALLBACK>
+                TOKEN_ITERATOR feed_symbols(TOKEN_ITERATOR begin, TOKEN_ITERATOR end, REDUCE_CALLBACK callback)
+                {
+                    for (; begin != end; ++begin)
+                        if (try_feed(*begin, callback) != PARSE_OK)
+                            return begin;
+                    return end;
+                }
+            template <typename TOKEN_ITERATOR>
+                TOKEN_ITERATOR feed_symbols(TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                {
+                    return feed_symbols(begin, end, default_action());
+                }
+            //replaces the right hand side on top of the stack with the
+            //callback's value; false, with the session unchanged, if the
+            //left hand side has no goto. If the callback throws, the values
+            //go back to their nodes and the session is unchanged too.
+            template <typename REDUCE_CALLBACK>
+                bool reduce(uint rule_index, REDUCE_CALLBACK& callback)
+                {
+                    const rule& reduced = pool->automaton->get_rule(rule_index);
+                    uint size = reduced.size();
+                    typename pool_type::node* nodes = &pool->nodes[0];
+                    uint below = top;
+                    for (uint i = size; i; --i)
+                        below = nodes[below].parent;
+                    state next = lookup_goto(*pool->automaton, nodes[below].s, reduced.get_left_hand(), pool->stats);
+                    if (next == AUTOMATON::invalid_state)
+                        return false;
+                    pool->right_hand.resize(size);
+                    TOKEN_TYPE value;
+                    try {
+                        //values are moved out of the nodes only this session reaches
+                        bool shared = false;
+                        uint taken_index = top;
+                        for (uint i = size; i; --i) {
+                            typename pool_type::node& taken = nodes[taken_index];
+                            shared = shared || taken.references > 1;
+                            if (shared)
+                                pool->right_hand[i - 1] = taken.value;
+                            else
+                                pool->right_hand[i - 1] = std::move(taken.value);
+                            taken_index = taken.parent;
+                        }
+                        value = callback(reduced, pool->right_hand.begin(), pool->right_hand.end());
+                    } catch (...) {
+                        give_back(size);
+                        throw;
+                    }
+                    pool->stats.on_value();
+                    //the new node takes the reference to below before top's
+                    //nodes are released
+                    pool->acquire(below);
+                    uint pushed;
+                    try {
+                        pushed = pool->push(next, below, std::move(value));
+                    } catch (...) {
+                        pool->release(below);
+                        throw;
+                    }
+                    pool->release(top);
+                    top = pushed;
+                    stack_depth = stack_depth - size + 1;
+                    pool->stats.on_reduce(rule_index, stack_depth);
+                    return true;
+                }
+            //moves the right hand side values back into the nodes they were
+            //moved out of
+            void give_back(uint size)
+            {
+                bool shared = false;
+                uint taken_index = top;
+                for (uint i = size; i; --i) {
+                    typename pool_type::node& taken = pool->nodes[taken_index];
+                    shared = shared || taken.references > 1;
+                    if (!shared)
+                        taken.value = std::move(pool->right_hand[i - 1]);
+                    taken_index = taken.parent;
+                }
+            }
+        };
+}
+
+#endif
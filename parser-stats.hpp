@@ -0,0 +1,106 @@
+#ifndef PARSER_STATS_HPP
+#define PARSER_STATS_HPP
+// vim: set cino=; set sw=4; set ts=4
+//a statistics policy for the contexts, counting what no_stats ignores:
+//
+//  parser::default_parser::context<token, parser::default_parser, parser::counting_stats> context(p, 's');
+//  ... feed symbols ...
+//  context.stats.reductions_by_rule, context.stats.cache_misses, ...
+//
+//phase(name) records a timestamp when record_phases is set and calls the
+//hook, if there is one, with the counts so far.
+#include <chrono>
+#include <utility>
+#include <vector>
+#include "parser.hpp"
+
+namespace parser {
+    struct counting_stats
+    {
+        typedef unsigned long long counter;
+        typedef std::chrono::steady_clock clock;
+        typedef void (*hook_function)(const counting_stats& stats, const char* phase, void* data);
+
+        counter shifts;
+        counter reductions;
+        std::vector<counter> reductions_by_rule;
+        std::vector<counter> shifts_by_state;
+        counter values;//semantic values made by the reduce callbacks
+        counter cache_hits;
+        counter cache_misses;
+        counter next_calls;//successor states computed
+        counter closures;//item set closures taken for them
+        counter syntax_errors;
+        size_t max_depth;//parse_stack high-water mark
+
+        bool record_phases;
+        std::vector<std::pair<const char*, clock::time_point> > phases;
+        hook_function hook;
+        void* hook_data;
+
+        counting_stats()
+            :record_phases(false), hook(0), hook_data(0)
+        {
+            reset();
+        }
+        //clears the counts and phases, keeps the settings and the hook
+        void reset()
+        {
+            shifts = reductions = values = cache_hits = cache_misses = next_calls = closures = syntax_errors = 0;
+            max_depth = 0;
+            reductions_by_rule.clear();
+            shifts_by_state.clear();
+            phases.clear();
+        }
+
+        void on_shift(unsigned int state, size_t depth)
+        {
+            ++shifts;
+            if (state >= shifts_by_state.size())
+                shifts_by_state.resize(state + 1, 0);
+            ++shifts_by_state[state];
+            max_depth = std::max(max_depth, depth);
+        }
+        void on_reduce(unsigned int rule_index, size_t depth)
+        {
+            ++reductions;
+            if (rule_index >= reductions_by_rule.size())
+                reductions_by_rule.resize(rule_index + 1, 0);
+            ++reductions_by_rule[rule_index];
+            max_depth = std::max(max_depth, depth);
+        }
+        void on_value()
+        {
+            ++values;
+        }
+        void on_cache_hit()
+        {
+            ++cache_hits;
+        }
+        void on_cache_miss()
+        {
+            ++cache_misses;
+        }
+        void on_next()
+        {
+            ++next_calls;
+        }
+        void on_closure()
+        {
+            ++closures;
+        }
+        void on_syntax_error()
+        {
+            ++syntax_errors;
+        }
+        void phase(const char* name)
+        {
+            if (record_phases)
+                phases.push_back(std::make_pair(name, clock::now()));
+            if (hook)
+                hook(*this, name, hook_data);
+        }
+    };
+}
+
+#endif
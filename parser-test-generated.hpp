@@ -0,0 +1,260 @@
+//generated by parser-codegen, do not edit
+#ifndef test_grammar_GENERATED_HPP
+#define test_grammar_GENERATED_HPP
+#include <stdexcept>
+#include <utility>
+#include "parser.hpp"
+
+struct test_grammar
+{
+    typedef parser::default_parser::uint uint;
+    typedef parser::default_parser::symbol symbol;
+    typedef parser::default_parser::rule rule;
+    template <typename T>
+        struct types : parser::default_parser::types<T>{};
+
+    static const rule& get_rule(uint rule_index)
+    {
+        static const symbol right_hands[] = {0, 101/*'e'*/, 36/*'$'*/, 101/*'e'*/, 43/*'+'*/, 101/*'e'*/, 101/*'e'*/, 42, 101/*'e'*/, 40/*'('*/, 101/*'e'*/, 41/*')'*/, 105/*'i'*/};
+        static const rule rules[] = {
+            rule(115/*'s'*/, right_hands + 1, right_hands + 3, 0, parser::NOASSOC),
+            rule(101/*'e'*/, right_hands + 3, right_hands + 6, 1, parser::LEFT_ASSOC),
+            rule(101/*'e'*/, right_hands + 6, right_hands + 9, 2, parser::LEFT_ASSOC),
+            rule(101/*'e'*/, right_hands + 9, right_hands + 12, 3, parser::NOASSOC),
+            rule(101/*'e'*/, right_hands + 12, right_hands + 13, 2, parser::NOASSOC)
+        };
+        return rules[rule_index];
+    }
+
+    static uint goto_2(uint state)//115/*'s'*/
+    {
+        switch (state) {
+        }
+        throw std::runtime_error("syntax error");
+    }
+    static uint goto_3(uint state)//101/*'e'*/
+    {
+        switch (state) {
+            case 0: return 2;
+            case 3: return 7;
+            case 4: return 8;
+            case 5: return 9;
+        }
+        throw std::runtime_error("syntax error");
+    }
+
+    template <typename TOKEN_TYPE>
+        struct context
+        {
+            typename types<uint>::indexed_stack parse_stack;
+            typename types<TOKEN_TYPE>::indexed_stack token_stack;
+
+            context()
+            {
+                parse_stack.push_back(0);
+            }
+            struct default_action
+            {
+                template <typename TOKEN_ITERATOR>
+                    TOKEN_TYPE operator()(const rule& rule, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                    {
+                        return TOKEN_TYPE(rule, begin, end);
+                    }
+            };
+            void feed_symbol(const TOKEN_TYPE& lookup_token)
+            {
+                feed_symbol(TOKEN_TYPE(lookup_token), default_action());
+            }
+            void feed_symbol(TOKEN_TYPE&& lookup_token)
+            {
+                feed_symbol(std::move(lookup_token), default_action());
+            }
+            template <typename REDUCE_CALLBACK>
+                void feed_symbol(const TOKEN_TYPE& lookup_token, REDUCE_CALLBACK callback)
+                {
+                    feed_symbol(TOKEN_TYPE(lookup_token), callback);
+                }
+            template <typename REDUCE_CALLBACK>
+                void feed_symbol(TOKEN_TYPE&& lookup_token, REDUCE_CALLBACK callback)
+                {
+                    const symbol lookup = lookup_token.get_symbol();
+                    for (;;) {
+                        switch (parse_stack.back()) {
+                            case 0:
+                                switch (lookup) {
+                                    case 105/*'i'*/:
+                                        parse_stack.push_back(1);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 101/*'e'*/:
+                                        parse_stack.push_back(2);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 40/*'('*/:
+                                        parse_stack.push_back(3);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                }
+                                break;
+                            case 1:
+                                switch (lookup) {
+                                    case 43/*'+'*/:
+                                    case 42:
+                                    case 36/*'$'*/:
+                                    case 41/*')'*/:
+                                        {
+                                            uint next = goto_3(*(parse_stack.end() - 2));
+                                            TOKEN_TYPE new_token = callback(get_rule(4), token_stack.end() - 1, token_stack.end());
+                                            *(token_stack.end() - 1) = std::move(new_token);
+                                            parse_stack.pop(1);
+                                            parse_stack.push_back(next);
+                                        }
+                                        continue;
+                                }
+                                break;
+                            case 2:
+                                switch (lookup) {
+                                    case 43/*'+'*/:
+                                        parse_stack.push_back(4);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 42:
+                                        parse_stack.push_back(5);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 36/*'$'*/:
+                                        parse_stack.push_back(6);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                }
+                                break;
+                            case 3:
+                                switch (lookup) {
+                                    case 105/*'i'*/:
+                                        parse_stack.push_back(1);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 101/*'e'*/:
+                                        parse_stack.push_back(7);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 40/*'('*/:
+                                        parse_stack.push_back(3);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                }
+                                break;
+                            case 4:
+                                switch (lookup) {
+                                    case 105/*'i'*/:
+                                        parse_stack.push_back(1);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 101/*'e'*/:
+                                        parse_stack.push_back(8);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 40/*'('*/:
+                                        parse_stack.push_back(3);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                }
+                                break;
+                            case 5:
+                                switch (lookup) {
+                                    case 105/*'i'*/:
+                                        parse_stack.push_back(1);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 101/*'e'*/:
+                                        parse_stack.push_back(9);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 40/*'('*/:
+                                        parse_stack.push_back(3);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                }
+                                break;
+                            case 6:
+                                switch (lookup) {
+                                }
+                                break;
+                            case 7:
+                                switch (lookup) {
+                                    case 43/*'+'*/:
+                                        parse_stack.push_back(4);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 42:
+                                        parse_stack.push_back(5);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                    case 41/*')'*/:
+                                        parse_stack.push_back(10);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                }
+                                break;
+                            case 8:
+                                switch (lookup) {
+                                    case 43/*'+'*/:
+                                    case 36/*'$'*/:
+                                    case 41/*')'*/:
+                                        {
+                                            uint next = goto_3(*(parse_stack.end() - 4));
+                                            TOKEN_TYPE new_token = callback(get_rule(1), token_stack.end() - 3, token_stack.end());
+                                            *(token_stack.end() - 3) = std::move(new_token);
+                                            token_stack.pop(2);
+                                            parse_stack.pop(3);
+                                            parse_stack.push_back(next);
+                                        }
+                                        continue;
+                                    case 42:
+                                        parse_stack.push_back(5);
+                                        token_stack.push_back(std::move(lookup_token));
+                                        return;
+                                }
+                                break;
+                            case 9:
+                                switch (lookup) {
+                                    case 43/*'+'*/:
+                                    case 42:
+                                    case 36/*'$'*/:
+                                    case 41/*')'*/:
+                                        {
+                                            uint next = goto_3(*(parse_stack.end() - 4));
+                                            TOKEN_TYPE new_token = callback(get_rule(2), token_stack.end() - 3, token_stack.end());
+                                            *(token_stack.end() - 3) = std::move(new_token);
+                                            token_stack.pop(2);
+                                            parse_stack.pop(3);
+                                            parse_stack.push_back(next);
+                                        }
+                                        continue;
+                                }
+                                break;
+                            case 10:
+                                switch (lookup) {
+                                    case 43/*'+'*/:
+                                    case 42:
+                                    case 36/*'$'*/:
+                                    case 41/*')'*/:
+                                        {
+                                            uint next = goto_3(*(parse_stack.end() - 4));
+                                            TOKEN_TYPE new_token = callback(get_rule(3), token_stack.end() - 3, token_stack.end());
+                                            *(token_stack.end() - 3) = std::move(new_token);
+                                            token_stack.pop(2);
+                                            parse_stack.pop(3);
+                                            parse_stack.push_back(next);
+                                        }
+                                        continue;
+                                }
+                                break;
+                        }
+                        throw std::runtime_error("syntax error");
+                    }
+                }
+        };
+};
+
+#endif
@@ -1,5 +1,23 @@
 #include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
 #include "parser.hpp"
+#include "parser-arena.hpp"
+#include "parser-batch.hpp"
+#include "parser-codegen.hpp"
+#include "parser-glr.hpp"
+#include "parser-image.hpp"
+#include "parser-incremental.hpp"
+#include "parser-lexer.hpp"
+#include "parser-pipeline.hpp"
+#include "parser-session.hpp"
+#include "parser-stats.hpp"
+#include "parser-tree.hpp"
+#include "parser-test-generated.hpp"
+#if __cplusplus >= 201703L
+#include "parser-constexpr.hpp"
+#endif
 
 #define DOT_CHAR 'O'
 
@@ -14,7 +32,8 @@ typedef parser::default_parser::symbol symbol;
 typedef parser::default_parser::rule rule;
 typedef parser::default_parser::item_set item_set;
 
-void print (const parser::default_parser::rule &rule)
+template <typename RULE>
+void print (const RULE &rule)
 {
     putchar(rule.get_left_hand());
     printf(" -> ");
@@ -56,13 +75,107 @@ struct token
     {
         this->s = s;
     }
-    template<typename ITERATOR>
-        token(const rule &r, ITERATOR begin, ITERATOR end)
+    token(const symbol &s, const char *, const char *)
+    {
+        this->s = s;
+    }
+    template<typename RULE, typename ITERATOR>
+        token(const RULE &r, ITERATOR begin, ITERATOR end)
         {
             s = r.get_left_hand();
             print(r);
         }
 };
+//a token that can only be moved
+struct moved_token
+{
+    symbol s;
+    explicit moved_token(const symbol &s)
+        :s(s)
+    {}
+    moved_token(moved_token&&) = default;
+    moved_token& operator=(moved_token&&) = default;
+    moved_token(const moved_token&) = delete;
+    moved_token& operator=(const moved_token&) = delete;
+    const symbol& get_symbol()const
+    {
+        return s;
+    }
+};
+struct moved_action
+{
+    template<typename RULE, typename ITERATOR>
+        moved_token operator()(const RULE &r, ITERATOR, ITERATOR)
+        {
+            print(r);
+            return moved_token(r.get_left_hand());
+        }
+};
+//a reduce callback that throws at the countdown-th call of all its copies
+struct throwing_action
+{
+    int *countdown;
+    template<typename RULE, typename ITERATOR>
+        token operator()(const RULE &r, ITERATOR, ITERATOR)
+        {
+            if (!--*countdown)
+                throw std::runtime_error("reduce callback failed");
+            return token(r.get_left_hand());
+        }
+};
+//a reduce callback that prints nothing, for long inputs
+struct quiet_action
+{
+    template<typename RULE, typename ITERATOR>
+        token operator()(const RULE &r, ITERATOR, ITERATOR)
+        {
+            return token(r.get_left_hand());
+        }
+};
+template <typename CONTEXT>
+void feed_text(CONTEXT &context, const char *text)
+{
+    while (*text)
+        context.feed_symbol(token(*text++));
+}
+template <typename CONTEXT>
+struct lexed_feeder
+{
+    CONTEXT *context;
+    void operator()(symbol s, const char *, const char *)
+    {
+        context->feed_symbol(token(s));
+    }
+};
+//prints the rule of every node it leaves, which is the order of the reductions
+struct rule_printer
+{
+    const parser::default_parser::parse_table* table;
+    const parser::tree_view* tree;
+    void enter(unsigned int)
+    {
+    }
+    void leave(unsigned int node)
+    {
+        if (!tree->is_token(node))
+            print(table->get_rule(tree->rule(node)));
+    }
+};
+//the number of trees in the forest below node
+template <typename TABLE, typename FOREST>
+unsigned long count_trees(const TABLE &table, const FOREST &forest, unsigned int node)
+{
+    if (forest.is_token(node))
+        return 1;
+    unsigned long trees = 0;
+    for (unsigned int packed = forest.nodes[node].first_packed; packed != FOREST::none; packed = forest.packed[packed].next) {
+        unsigned long product = 1;
+        for (unsigned int i = 0; i < table.get_rule(forest.packed[packed].rule_index).size(); ++i)
+            product *= count_trees(table, forest, forest.get_children(packed)[i]);
+        trees += product;
+    }
+    return trees;
+}
 struct srule
 {
     unsigned int left_hand;
@@ -77,6 +190,19 @@ struct srule
         return rule(left_hand, right_hand, right_hand + sz, precedence, assoc);
     }
 };
+#if __cplusplus >= 201703L
+struct static_grammar
+{
+    static constexpr unsigned int symbols[] = {'i', '+', 's', 'e', '*', '$', '(', ')'};
+    static constexpr parser::static_rule rules[] = {
+        {'s', "e$", 0, parser::NOASSOC},
+        {'e', "e+e", 1, parser::LEFT_ASSOC},
+        {'e', "e*e", 2, parser::LEFT_ASSOC},
+        {'e', "(e)", 3, parser::NOASSOC},
+        {'e', "i", 2, parser::NOASSOC}};
+    static constexpr unsigned int start_symbol = 's';
+};
+#endif
 int main()
 {
     try {
@@ -88,8 +214,8 @@ int main()
             {'e', "e*e", 2, parser::LEFT_ASSOC},
             {'e', "(e)", 3, parser::NOASSOC},
             {'e', "i", 2, parser::NOASSOC}};
-        const char *input = "i+i*(i+i)*i+i";
-        p.symbols.assign(symbols, symbols + 9);
+        const char *text = "i+i*(i+i)*i+i$";
+        p.symbols.assign(symbols, symbols + sizeof(symbols) / sizeof(*symbols));
         for (int i = 0; i < 5; ++i) {
             p.rules.push_back(rules[i].get_rule());
         }            
@@ -102,12 +228,277 @@ int main()
 #endif
         fflush(stdout);
         parser::default_parser::context<token> context(p, 's');
-        while(*input) 
+        feed_text(context, text);
+
+        //every lookup is one hit or one miss, from a cold cache
+        p.clear_cache();
+        parser::default_parser::context<token, parser::default_parser, parser::counting_stats> counted(p, 's');
+        for (const char *c = text; *c; ++c)
+            counted.feed_symbol(token(*c), quiet_action());
+        printf("counted: %llu lookups for %llu shifts and %llu reductions, %llu successors, %llu closures\n",
+                counted.stats.cache_hits + counted.stats.cache_misses, counted.stats.shifts, counted.stats.reductions,
+                counted.stats.next_calls, counted.stats.closures);
+
+        puts("compiled:");
+        parser::default_parser::parse_table table = p.compile('s');
+        parser::default_parser::table_context<token, parser::arena_stack_types> compiled(table);
+        feed_text(compiled, text);
+
+        puts("lalr:");
+        parser::default_parser::conflict_list conflicts;
+        parser::default_parser::parse_table lalr_table = p.compile_lalr('s', conflicts);
+        for (size_t i = 0; i < conflicts.size(); ++i)
+            printf("state %u on %c: %s\n", conflicts[i].state, conflicts[i].lookahead, conflicts[i].message);
+        parser::default_parser::table_context<token> lalr(lalr_table);
+        feed_text(lalr, text);
+
+        puts("folded:");
+        parser::default_parser::parse_table folded_table = lalr_table;
+        folded_table.fold_unit_rules();
+        parser::default_parser::table_context<token> folded(folded_table);
+        feed_text(folded, text);
+
+        puts("compressed:");
+        parser::default_parser::compressed_table compressed_table(lalr_table);
+        parser::default_parser::compressed_context<token> compressed(compressed_table);
+        std::vector<token> tokens(text, text + strlen(text));
+        if (compressed.feed_symbols(tokens.begin(), tokens.end()) != tokens.end())
+            puts("syntax error");
+
+        puts("lexed:");
+        parser::default_lexer lexer;
+        const char *operators[] = {"i", "\\+", "\\*", "\\(", "\\)", "\\$"};
+        for (int i = 0; i < 6; ++i)
+            lexer.add(operators[i], operators[i][strlen(operators[i]) - 1]);
+        lexer.skip("[ \t]+");
+        const char *spaced = "i + i*(i+i) * i + i $";
+        parser::default_parser::table_context<token> lexed(lalr_table);
+        lexed_feeder<parser::default_parser::table_context<token> > feeder = {&lexed};
+        if (lexer.scan(spaced, spaced + strlen(spaced), feeder) != spaced + strlen(spaced))
+            puts("lexical error");
+
+        puts("pipeline:");
+        //more tokens than the ring holds, so that it wraps
+        std::string sum;
+        for (int i = 0; i < 100; ++i)
+            sum += "i + ";
+        std::string summed = sum + "i $", unbalanced = "i + i + ) + " + sum + "i $", unlexed = "i + i # i $";
+        const std::string *piped_texts[] = {&summed, &unbalanced, &unlexed};
+        for (int i = 0; i < 3; ++i) {
+            parser::default_parser::table_context<token> piped(lalr_table);
+            const char *piped_text = piped_texts[i]->data();
+            parser::pipeline_result result = parser::parse_pipelined(lexer, piped_text, piped_text + piped_texts[i]->size(),
+                    piped, quiet_action(), 16);
+            if (result.error_offset == parser::pipeline_result::no_error)
+                printf("%d tokens\n", int(result.tokens));
+            else
+                printf("%d tokens, %s error at %d\n", int(result.tokens), result.lexical ? "lexical" : "syntax",
+                        int(result.error_offset));
+        }
+        //the lexer waits on a full ring when the callback throws
+        try {
+            parser::default_parser::table_context<token> thrown(lalr_table);
+            int countdown = 20;
+            throwing_action thrower = {&countdown};
+            parser::parse_pipelined(lexer, summed.data(), summed.data() + summed.size(), thrown, thrower, 16);
+            puts("no exception");
+        } catch (std::exception &ex) {
+            puts(ex.what());
+        }
+
+        puts("glr:");
+        parser::glr_table<parser::default_parser> glr_table(p, 's');
+        parser::glr_context<parser::default_parser, token> glr(glr_table);
+        feed_text(glr, text);
+        glr.evaluate(glr.finish());
+        //ambiguous: e -> e+e | i
+        parser::default_parser ambiguous;
+        unsigned int ambiguous_symbols[] = {'i', '+', 'e'};
+        srule ambiguous_rules[] = {
+            {'e', "e+e", 0, parser::NOASSOC},
+            {'e', "i", 0, parser::NOASSOC}};
+        ambiguous.symbols.assign(ambiguous_symbols, ambiguous_symbols + 3);
+        for (int i = 0; i < 2; ++i)
+            ambiguous.rules.push_back(ambiguous_rules[i].get_rule());
+        parser::glr_table<parser::default_parser> ambiguous_table(ambiguous, 'e');
+        parser::glr_context<parser::default_parser, token> ambiguous_glr(ambiguous_table);
+        const char *sums[] = {"i", "i+i", "i+i+i", "i+i+i+i", "i+i+i+i+i"};
+        for (int i = 0; i < 5; ++i) {
+            ambiguous_glr.reset();
+            for (const char *c = sums[i]; *c; ++c)
+                ambiguous_glr.feed_symbol(token(*c));
+            printf("%s: %lu derivations\n", sums[i], count_trees(ambiguous_table, ambiguous_glr.forest, ambiguous_glr.finish()));
+        }
+        //epsilon rules: s -> a i a, a -> i | (empty)
+        parser::default_parser nullable;
+        unsigned int nullable_symbols[] = {'i', 's', 'a'};
+        srule nullable_rules[] = {
+            {'s', "aia", 0, parser::NOASSOC},
+            {'a', "i", 0, parser::NOASSOC},
+            {'a', "", 0, parser::NOASSOC}};
+        nullable.symbols.assign(nullable_symbols, nullable_symbols + 3);
+        for (int i = 0; i < 3; ++i)
+            nullable.rules.push_back(nullable_rules[i].get_rule());
+        parser::glr_table<parser::default_parser> nullable_table(nullable, 's');
+        parser::glr_context<parser::default_parser, token> nullable_glr(nullable_table);
+        const char *runs[] = {"i", "ii", "iii", "iiii"};
+        for (int i = 0; i < 4; ++i) {
+            nullable_glr.reset();
+            bool parsed = true;
+            for (const char *c = runs[i]; *c && parsed; ++c)
+                parsed = nullable_glr.try_feed_symbol(token(*c)) == parser::PARSE_OK;
+            try {
+                if (parsed)
+                    printf("%s: %lu derivations\n", runs[i], count_trees(nullable_table, nullable_glr.forest, nullable_glr.finish()));
+                else
+                    printf("%s: syntax error\n", runs[i]);
+            } catch (std::exception &ex) {
+                printf("%s: %s\n", runs[i], ex.what());
+            }
+        }
+
+        puts("incremental:");
+        parser::incremental_context<parser::default_parser::parse_table, token> incremental(lalr_table, lalr_table.get_initial_state(), 4);
+        const char *unedited = "i+i*i+i$";
+        std::vector<token> before(unedited, unedited + strlen(unedited)), inserted(text + 4, text + 11);
+        incremental.assign(before.begin(), before.end());
+        if (incremental.replace(4, 5, inserted.begin(), inserted.end()) != parser::PARSE_OK)
+            puts("syntax error");
+        incremental.evaluate();
+        const char *erroneous = "i+i+i+i+i)+i$", *parenthesized = "(i)";
+        std::vector<token> with_error(erroneous, erroneous + strlen(erroneous)), wrapped(parenthesized, parenthesized + 3);
+        parser::incremental_context<parser::default_parser::parse_table, token> erroneous_document(lalr_table, lalr_table.get_initial_state(), 4);
+        erroneous_document.assign(with_error.begin(), with_error.end());
+        parser::PARSE_STATUS edited = erroneous_document.replace(0, 1, wrapped.begin(), wrapped.end());
+        printf("edit before the error: %s at %d\n", edited == parser::PARSE_OK ? "ok" : "failed", int(erroneous_document.error_position));
+
+        puts("session:");
+        typedef parser::parse_session<parser::default_parser::parse_table, token> session_type;
+        parser::session_pool<parser::default_parser::parse_table, token> pool(lalr_table, lalr_table.get_initial_state());
+        session_type session(pool);
+        lexed_feeder<session_type> session_feeder = {&session};
+        bool failed;
+        const char* kept = lexer.scan_partial(spaced, spaced + 8, session_feeder, failed);
+        std::string rest = std::string(kept, spaced + 8) + (spaced + 8);
+        session_type forked = session.fork();
+        session.reset();
+        session_feeder.context = &forked;
+        if (failed || lexer.scan(rest.data(), rest.data() + rest.size(), session_feeder) != rest.data() + rest.size())
+            puts("lexical error");
+
+        puts("batch:");
+        std::vector<std::vector<token> > documents(2);
+        documents[0].assign(text, text + strlen(text));
+        const char *bad = "i+)";
+        documents[1].assign(bad, bad + strlen(bad));
+        std::vector<size_t> errors;
+        parser::parse_batch(lalr, documents.begin(), documents.end(), errors,
+                parser::default_parser::table_context<token>::default_action(), parser::ignore_batch_result(), 1);
+        printf("errors: %d %d\n", errors[0] == parser::batch_no_error ? -1 : int(errors[0]), int(errors[1]));
+
+        puts("tree:");
+        parser::tree_context<parser::default_parser::parse_table> tree_parsed(lalr_table);
+        if (tree_parsed.feed_symbols(tokens.begin(), tokens.end()) != tokens.end())
+            puts("syntax error");
+        parser::tree_view tree = tree_parsed.tree.view();
+        rule_printer printer = {&lalr_table, &tree};
+        tree.walk(printer);
+
+        puts("after the end:");
+        const char *ended_texts[] = {"i$i", "i$$"};
+        for (int i = 0; i < 2; ++i) {
+            const char *ended_text = ended_texts[i];
+            std::vector<token> ended_tokens(ended_text, ended_text + strlen(ended_text));
+            parser::default_parser::table_context<token> ended(table);
+            try {
+                feed_text(ended, ended_text);
+            } catch (std::exception &ex) {
+                printf("%s: %s\n", ended_text, ex.what());
+            }
+            parser::default_parser::context<token> ended_interpreted(p, 's');
+            try {
+                feed_text(ended_interpreted, ended_text);
+            } catch (std::exception &ex) {
+                printf("%s: interpreted: %s\n", ended_text, ex.what());
+            }
+            if (p.get_action(parser::default_parser::invalid_state, ended_text[2]).get_type() != parser::INVALID_ACTION)
+                printf("%s: action after invalid_state\n", ended_text);
+            parser::default_parser::table_context<token> ended_range(table);
+            printf("%s: feed_symbols stops at %d\n", ended_text,
+                    int(ended_range.feed_symbols(ended_tokens.begin(), ended_tokens.end()) - ended_tokens.begin()));
+            session_type ended_session(pool);
+            for (size_t j = 0; j < ended_tokens.size(); ++j)
+                if (ended_session.try_feed_symbol(ended_tokens[j]) != parser::PARSE_OK)
+                    printf("%s: session fails at %d\n", ended_text, int(j));
+            parser::tree_context<parser::default_parser::parse_table> ended_tree(lalr_table);
+            printf("%s: tree stops at %d\n", ended_text,
+                    int(ended_tree.feed_symbols(ended_tokens.begin(), ended_tokens.end()) - ended_tokens.begin()));
+            parser::incremental_context<parser::default_parser::parse_table, token> ended_document(lalr_table, lalr_table.get_initial_state());
+            if (ended_document.assign(ended_tokens.begin(), ended_tokens.end()) != parser::PARSE_OK)
+                printf("%s: document fails at %d\n", ended_text, int(ended_document.error_position));
+        }
+
+        puts("image:");
+        FILE *image_file = fopen("parser-test.lrt", "wb");
+        if (!image_file)
+            throw std::runtime_error("cannot create parser-test.lrt");
+        parser::write_image(image_file, compressed_table);
+        fclose(image_file);
         {
-            context.feed_symbol(*input++);
+            parser::mapped_image mapped("parser-test.lrt", parser::grammar_checksum(p));
+            parser::image_context<token> imaged(mapped.table);
+            feed_text(imaged, text);
+        }
+        remove("parser-test.lrt");
+        std::vector<uint32_t> image;
+        parser::build_image(compressed_table, image);
+        image[parser::image_detail::H_ACTION_BASE] = 0x40000000;
+        for (int verify = 1; verify >= 0; --verify) {
+            try {
+                parser::table_image corrupted(&image[0], image.size() * sizeof(uint32_t), 0, verify != 0);
+                puts("corrupted image accepted");
+            } catch (std::exception &ex) {
+                puts(ex.what());
+            }
         }
-        context.feed_symbol(token('$'));
 
+        puts("generated:");
+        //parser-test-generated.hpp is what parser-codegen writes for this table
+        FILE *generated = tmpfile();
+        if (!generated)
+            throw std::runtime_error("cannot create a temporary file");
+        parser::emit_directly_coded(generated, lalr_table, "test_grammar");
+        rewind(generated);
+        FILE *checked_in = fopen("parser-test-generated.hpp", "rb");
+        if (checked_in) {
+            int a, b;
+            do {
+                a = getc(generated);
+                b = getc(checked_in);
+            } while (a == b && a != EOF);
+            if (a != b)
+                puts("parser-test-generated.hpp is out of date");
+            fclose(checked_in);
+        }
+        fclose(generated);
+        test_grammar::context<token> generated_parsed;
+        feed_text(generated_parsed, text);
+        test_grammar::context<moved_token> generated_moved;
+        for (const char *c = "(i)$"; *c; ++c)
+            generated_moved.feed_symbol(moved_token(*c), moved_action());
+        test_grammar::context<moved_token> generated_ended;
+        try {
+            for (const char *c = "i$i"; *c; ++c)
+                generated_ended.feed_symbol(moved_token(*c), moved_action());
+        } catch (std::exception &ex) {
+            printf("i$i: %s\n", ex.what());
+        }
+
+#if __cplusplus >= 201703L
+        puts("static:");
+        parser::static_context<static_grammar, token> static_parsed;
+        feed_text(static_parsed, text);
+#endif
     } catch(std::exception &ex) {
         printf("exception: %s\n", ex.what());
     }
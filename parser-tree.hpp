@@ -0,0 +1,378 @@
+#ifndef PARSER_TREE_HPP
+#define PARSER_TREE_HPP
+// vim: set cino=; set sw=4; set ts=4
+//a concrete syntax tree recorded as a flat array:
+//
+//  parser::tree_context<parser::default_parser::parse_table> context(table);
+//  if (context.feed_symbols(tokens.begin(), tokens.end()) != tokens.end())
+//      ... syntax error ...
+//  parser::tree_view tree = context.tree.view();
+//  tree.walk(visitor);//visitor.enter(node) and visitor.leave(node)
+//
+//An LR parse shifts and reduces in the postorder of its tree, so the
+//context appends a node at every shift and every reduction and never moves
+//one. A node is its index; per node the tree keeps, in separate columns,
+//the symbol, the rule (no_rule for tokens), the child count, the subtree
+//size in nodes and the span [token_begin, token_end) of token positions
+//counted from 0. The children of a node are found from its right end: the
+//last child is node - 1, and each child's previous sibling is
+//child - subtree_size(child).
+//
+//All columns live in one block of 32-bit words behind a small header, so
+//write_tree can save a tree as it is and tree_view can read it in place
+//from a mapped file. Like table images, a saved tree has the byte order of
+//the machine that wrote it.
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <stdint.h>
+#include "parser.hpp"
+
+namespace parser {
+    namespace tree_detail {
+        enum {
+            MAGIC = 0x5452544cu,//"LTRT"
+            VERSION = 1,
+            BYTE_ORDER_MARK = 0x01020304u
+        };
+        //indices of the header words
+        enum {
+            H_MAGIC,
+            H_VERSION,
+            H_BYTE_ORDER,
+            H_WORDS,//size of the block
+            H_NODES,
+            H_CAPACITY,//words per column
+            HEADER_WORDS
+        };
+        enum {
+            SYMBOLS,
+            RULES,
+            CHILD_COUNTS,
+            SUBTREE_SIZES,
+            TOKEN_BEGINS,
+            TOKEN_ENDS,
+            COLUMNS
+        };
+    }
+
+    //a tree read in place; a view, cheap to copy
+    struct tree_view
+    {
+        typedef uint32_t uint;
+        static const uint no_rule = uint(-1);
+
+        const uint32_t* words;
+
+        tree_view()
+            :words(0)
+        {}
+        //checks the header; throws std::runtime_error if data does not
+        //hold a tree
+        tree_view(const void* data, size_t size)
+            :words(static_cast<const uint32_t*>(data))
+        {
+            using namespace tree_detail;
+            if (reinterpret_cast<size_t>(data) % sizeof(uint32_t) || size < HEADER_WORDS * sizeof(uint32_t))
+                throw std::runtime_error("tree is misaligned or truncated");
+            if (words[H_MAGIC] != MAGIC || words[H_VERSION] != VERSION)
+                throw std::runtime_error("not a tree of this version");
+            if (words[H_BYTE_ORDER] != BYTE_ORDER_MARK)
+                throw std::runtime_error("tree has a different byte order");
+            if (size_t(words[H_WORDS]) * sizeof(uint32_t) > size
+                    || words[H_NODES] > words[H_CAPACITY]
+                    || HEADER_WORDS + size_t(words[H_CAPACITY]) * COLUMNS > words[H_WORDS])
+                throw std::runtime_error("tree is truncated");
+        }
+        const uint32_t* column(uint index) const
+        {
+            return words + tree_detail::HEADER_WORDS + size_t(index) * words[tree_detail::H_CAPACITY];
+        }
+        uint size() const
+        {
+            return words ? words[tree_detail::H_NODES] : 0;
+        }
+        uint symbol(uint node) const
+        {
+            return column(tree_detail::SYMBOLS)[node];
+        }
+        uint rule(uint node) const
+        {
+            return column(tree_detail::RULES)[node];
+        }
+        bool is_token(uint node) const
+        {
+            return rule(node) == no_rule;
+        }
+        uint child_count(uint node) const
+        {
+            return column(tree_detail::CHILD_COUNTS)[node];
+        }
+        uint subtree_size(uint node) const
+        {
+            return column(tree_detail::SUBTREE_SIZES)[node];
+        }
+        uint token_begin(uint node) const
+        {
+            return column(tree_detail::TOKEN_BEGINS)[node];
+        }
+        uint token_end(uint node) const
+        {
+            return column(tree_detail::TOKEN_ENDS)[node];
+        }
+        //the first node of the subtree, its leftmost leaf
+        uint first_descendant(uint node) const
+        {
+            return node + 1 - subtree_size(node);
+        }
+        //the sibling before node, which must not be a first child
+        uint previous_sibling(uint node) const
+        {
+            return node - subtree_size(node);
+        }
+        //appends the children of node, left to right
+        template <typename VECTOR>
+            void children(uint node, VECTOR& out) const
+            {
+                size_t first = out.size();
+                out.resize(first + child_count(node));
+                uint child = node - 1;
+                for (size_t i = out.size(); i != first; --i) {
+                    out[i - 1] = child;
+                    child -= subtree_size(child);
+                }
+            }
+        //appends the top-level trees, left to right: one per entry of
+        //the parse stack that built the tree
+        template <typename VECTOR>
+            void roots(VECTOR& out) const
+            {
+                size_t first = out.size();
+                for (uint node = size(); node; node -= subtree_size(node - 1))
+                    out.push_back(node - 1);
+                std::reverse(out.begin() + first, out.end());
+            }
+        //calls visitor.enter(node) before the subtree of node and
+        //visitor.leave(node) after it, in document order, without recursion
+        template <typename VISITOR>
+            void walk(uint root, VISITOR& visitor) const
+            {
+                std::vector<uint> pending(1, root);
+                walk_pending(pending, visitor);
+            }
+        //walks every top-level tree
+        template <typename VISITOR>
+            void walk(VISITOR& visitor) const
+            {
+                std::vector<uint> pending;
+                for (uint node = size(); node; node -= subtree_size(node - 1))
+                    pending.push_back(node - 1);
+                walk_pending(pending, visitor);
+            }
+        //nodes to enter, the next on top; LEAVE marks those to leave
+        template <typename VISITOR>
+            void walk_pending(std::vector<uint>& pending, VISITOR& visitor) const
+            {
+                const uint LEAVE = uint(1) << 31;
+                while (!pending.empty()) {
+                    uint node = pending.back();
+                    pending.pop_back();
+                    if (node & LEAVE) {
+                        visitor.leave(node & ~LEAVE);
+                        continue;
+                    }
+                    visitor.enter(node);
+                    pending.push_back(node | LEAVE);
+                    uint child = node - 1;
+                    for (uint i = child_count(node); i; --i) {
+                        pending.push_back(child);
+                        child -= subtree_size(child);
+                    }
+                }
+            }
+    };
+
+    //the growable block a tree is built in
+    struct flat_tree
+    {
+        typedef uint32_t uint;
+        static const uint no_rule = tree_view::no_rule;
+
+        std::vector<uint32_t> words;
+
+        flat_tree()
+        {
+            allocate(0);
+        }
+        uint size() const
+        {
+            return words[tree_detail::H_NODES];
+        }
+        uint capacity() const
+        {
+            return words[tree_detail::H_CAPACITY];
+        }
+        //views are invalidated when the tree grows
+        tree_view view() const
+        {
+            return tree_view(&words[0], words.size() * sizeof(uint32_t));
+        }
+        //empties the tree and keeps its storage
+        void clear()
+        {
+            words[tree_detail::H_NODES] = 0;
+        }
+        void reserve(uint nodes)
+        {
+            if (nodes > capacity())
+                allocate(nodes);
+        }
+        //moves the columns to a block with room for nodes
+        void allocate(uint nodes)
+        {
+            using namespace tree_detail;
+            std::vector<uint32_t> grown(HEADER_WORDS + size_t(nodes) * COLUMNS);
+            uint count = words.empty() ? 0 : size();
+            for (uint c = 0; c < COLUMNS && count; ++c)
+                std::copy(&words[HEADER_WORDS + size_t(c) * capacity()],
+                        &words[HEADER_WORDS + size_t(c) * capacity()] + count,
+                        &grown[HEADER_WORDS + size_t(c) * nodes]);
+            grown[H_MAGIC] = MAGIC;
+            grown[H_VERSION] = VERSION;
+            grown[H_BYTE_ORDER] = BYTE_ORDER_MARK;
+            grown[H_WORDS] = grown.size();
+            grown[H_NODES] = count;
+            grown[H_CAPACITY] = nodes;
+            words.swap(grown);
+        }
+        uint32_t* column(uint index)
+        {
+            return &words[tree_detail::HEADER_WORDS + size_t(index) * capacity()];
+        }
+        uint add(uint symbol, uint rule, uint child_count, uint subtree_size, uint token_begin, uint token_end)
+        {
+            using namespace tree_detail;
+            uint node = words[H_NODES];
+            if (node == words[H_CAPACITY])
+                allocate(node ? 2 * node : 64);
+            size_t stride = words[H_CAPACITY];
+            uint32_t* added = &words[HEADER_WORDS + node];
+            added[SYMBOLS * stride] = symbol;
+            added[RULES * stride] = rule;
+            added[CHILD_COUNTS * stride] = child_count;
+            added[SUBTREE_SIZES * stride] = subtree_size;
+            added[TOKEN_BEGINS * stride] = token_begin;
+            added[TOKEN_ENDS * stride] = token_end;
+            words[H_NODES] = node + 1;
+            return node;
+        }
+    };
+
+    inline void write_tree(FILE* out, const flat_tree& tree)
+    {
+        if (fwrite(&tree.words[0], sizeof(uint32_t), tree.words.size(), out) != tree.words.size())
+            throw std::runtime_error("cannot write the tree");
+    }
+
+    //parses like a context but keeps no values: it records the tree of the
+    //parse instead, with the tokens as positions
+    template <typename AUTOMATON, typename STATS = no_stats>
+        struct tree_context
+        {
+            typedef typename AUTOMATON::uint uint;
+            typedef typename AUTOMATON::state state;
+            typedef typename AUTOMATON::symbol symbol;
+            typedef typename AUTOMATON::rule rule;
+            typedef typename AUTOMATON::table_action table_action;
+
+            const AUTOMATON* automaton;
+            typename AUTOMATON::template types<state>::vector parse_stack;
+            flat_tree tree;
+            uint token_count;
+            STATS stats;
+
+            tree_context(const AUTOMATON& automaton)
+                :automaton(&automaton), token_count(0)
+            {
+                parse_stack.push_back(automaton.get_initial_state());
+            }
+            tree_context(const AUTOMATON& automaton, state initial_state)
+                :automaton(&automaton), token_count(0)
+            {
+                parse_stack.push_back(initial_state);
+            }
+            //back to the initial state; the tree keeps its storage
+            void clear()
+            {
+                parse_stack.resize(1);
+                tree.clear();
+                token_count = 0;
+            }
+            void feed_symbol(const symbol& lookup)
+            {
+                if (try_feed_symbol(lookup) != PARSE_OK)
+                    throw std::runtime_error("syntax error");
+            }
+            PARSE_STATUS try_feed_symbol(const symbol& lookup)
+            {
+                for (;;) {
+                    table_action needed_action = lookup_action(*automaton, parse_stack.back(), lookup, stats);
+                    switch (needed_action.get_type()) {
+                        case SHIFT:
+                            parse_stack.push_back(needed_action.get_value());
+                            stats.on_shift(parse_stack.back(), parse_stack.size());
+                            tree.add(lookup, flat_tree::no_rule, 0, 1, token_count, token_count + 1);
+                            ++token_count;
+                            return PARSE_OK;
+                        case REDUCE:
+                            if (reduce(needed_action.get_value()))
+                                break;
+                            //nothing to go to
+                            stats.on_syntax_error();
+                            return PARSE_FAILED;
+                        default:
+                            stats.on_syntax_error();
+                            return PARSE_FAILED;
+                    }
+                }
+            }
+            //feeds the symbols of a range of tokens; returns the position of
+            //the first one that has no action, or end
+            template <typename TOKEN_ITERATOR>
+                TOKEN_ITERATOR feed_symbols(TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                {
+                    for (; begin != end; ++begin)
+                        if (try_feed_symbol(begin->get_symbol()) != PARSE_OK)
+                            return begin;
+                    return end;
+                }
+            //adds the node of the rule over the subtrees on top of the
+            //stack; false, with nothing added, if the left hand side has
+            //no goto
+            bool reduce(uint rule_index)
+            {
+                const rule& reduced = automaton->get_rule(rule_index);
+                uint size = reduced.size();
+                state next = lookup_goto(*automaton, parse_stack[parse_stack.size() - size - 1], reduced.get_left_hand(), stats);
+                if (next == AUTOMATON::invalid_state)
+                    return false;
+                const uint32_t* subtree_sizes = tree.column(tree_detail::SUBTREE_SIZES);
+                const uint32_t* token_begins = tree.column(tree_detail::TOKEN_BEGINS);
+                uint first = tree.size();
+                for (uint i = 0; i < size; ++i)
+                    first -= subtree_sizes[first - 1];
+                uint token_end = size ? tree.column(tree_detail::TOKEN_ENDS)[tree.size() - 1] : token_count;
+                uint token_begin = size ? token_begins[first] : token_count;
+                tree.add(reduced.get_left_hand(), rule_index, size, tree.size() - first + 1, token_begin, token_end);
+                stats.on_value();
+                parse_stack.resize(parse_stack.size() - size);
+                parse_stack.push_back(next);
+                stats.on_reduce(rule_index, parse_stack.size());
+                return true;
+            }
+        };
+}
+
+#endif
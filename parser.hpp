@@ -2,8 +2,15 @@
 #define PARSER_HPP
 // vim: set cino=; set sw=4; set ts=4
 #include <stdexcept>
+#include <exception>
 #include <algorithm>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#ifdef _MSC_VER
 #include <intrin.h>
+#endif
 #ifndef DONT_DEFINE_PARSER_DEFAULT
 
 #include <vector>
@@ -22,6 +29,35 @@ namespace parser {
         SHIFT,
         INVALID_ACTION,
     };
+    //what try_feed_symbol did with a token
+    enum PARSE_STATUS {
+        PARSE_OK,//shifted
+        PARSE_ERROR,//a new syntax error at this token, recovered from with the error symbol
+        PARSE_DISCARDED,//dropped while recovering from an earlier error
+        PARSE_FAILED//no state on the stack shifts the error symbol
+    };
+    //index of the most significant set bit, value must not be 0
+    inline unsigned int highest_bit(unsigned int value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse(&index, value);
+        return index;
+#else
+        return 31 - __builtin_clz(value);
+#endif
+    }
+    //index of the least significant set bit, value must not be 0
+    inline unsigned int lowest_bit(unsigned int value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
 #ifndef DONT_DEFINE_PARSER_DEFAULT
 
     struct default_parser_params {
@@ -33,9 +69,10 @@ namespace parser {
                 typedef std::set<T> set;
                 struct indexed_stack : vector
                 {
+                    //erases rather than resizes, T need not be default constructible
                     void pop(uint n = 1)
                     {
-                        resize(size() - n);
+                        this->erase(this->end() - n, this->end());
                     }
                     size_t size() const
                     {
@@ -91,17 +128,20 @@ namespace parser {
                 }
 
             };
+            //an item refers to its rule by index into the grammar's rules,
+            //so copying and comparing it is cheap
             struct item
             {
+                uint rule_index;
                 uint dot_position;
-                rule on_rule;
+                const rule* on_rule;
 
-                item(rule on_rule)
-                    :dot_position(0), on_rule(on_rule)
+                item(uint rule_index, const rule& on_rule)
+                    :rule_index(rule_index), dot_position(0), on_rule(&on_rule)
                 {}
                 const symbol& get_left_hand() const
                 {
-                    return on_rule.get_left_hand();
+                    return on_rule->get_left_hand();
                 }
                 const uint& get_dot_position()const
                 {
@@ -109,41 +149,49 @@ namespace parser {
                 }
                 const rule& get_rule() const
                 {
-                    return on_rule;
+                    return *on_rule;
+                }
+                uint get_rule_index() const
+                {
+                    return rule_index;
                 }
                 const symbol& next_symbol() const
                 {
                     if (at_end())
                         throw std::runtime_error("cannot get next symbol if at end");
-                    return on_rule[dot_position];
+                    return (*on_rule)[dot_position];
                 }
                 bool can_progress(const symbol &s) const
                 {
-                    return dot_position < on_rule.size() && on_rule[dot_position] == s;
+                    return dot_position < on_rule->size() && (*on_rule)[dot_position] == s;
                 }
                 bool at_end() const
                 {
-                    return dot_position == on_rule.size();
+                    return dot_position == on_rule->size();
                 }
                 item next() const
                 {
                     if (at_end())
                         throw std::runtime_error("cannot progress after last symbol");
-                    return item(dot_position + 1, on_rule);
+                    return item(rule_index, dot_position + 1, *on_rule);
+                }
+                uint get_hash() const
+                {
+                    return rule_index * 0x9e3779b1u ^ dot_position;
                 }
                 bool operator<(const item& rh) const
                 {
                     if (dot_position == rh.dot_position)
-                        return on_rule < rh.on_rule;
+                        return rule_index < rh.rule_index;
                     return dot_position < rh.dot_position;
                 }
                 bool operator ==(const item& rh) const
                 {
-                    return dot_position == rh.dot_position && on_rule == rh.on_rule;
+                    return dot_position == rh.dot_position && rule_index == rh.rule_index;
                 }
                 protected:
-                item(uint dot_position, rule on_rule)
-                    :dot_position(dot_position), on_rule(on_rule)
+                item(uint rule_index, uint dot_position, const rule& on_rule)
+                    :rule_index(rule_index), dot_position(dot_position), on_rule(&on_rule)
                 {
                     if (dot_position > on_rule.size())
                         throw std::runtime_error("dot_position must be < on_rule.size()");
@@ -154,25 +202,33 @@ namespace parser {
             {
                 ACTION_TYPE type;
                 const rule* on_rule;
+                uint rule_index;
 
                 action(const action &action)
-                    :type(action.type), on_rule(action.on_rule)
+                    :type(action.type), on_rule(action.on_rule), rule_index(action.rule_index)
                 {
                 }
+                action& operator=(const action &action)
+                {
+                    type = action.type;
+                    on_rule = action.on_rule;
+                    rule_index = action.rule_index;
+                    return *this;
+                }
 
-                action(ACTION_TYPE type, const rule* on_rule)
-                    :type(type), on_rule(on_rule)
+                action(ACTION_TYPE type, const rule* on_rule, uint rule_index = 0)
+                    :type(type), on_rule(on_rule), rule_index(rule_index)
                 {}
-                action(ACTION_TYPE type, const rule& on_rule)
-                    :type(type), on_rule(&on_rule)
+                action(ACTION_TYPE type, const rule& on_rule, uint rule_index = 0)
+                    :type(type), on_rule(&on_rule), rule_index(rule_index)
                 {}
-                static action shift(const rule& on_rule)
+                static action shift(const item& on_item)
                 {
-                    return action(SHIFT, on_rule);//used for precedence
+                    return action(SHIFT, on_item.get_rule(), on_item.get_rule_index());//used for precedence
                 }
-                static action reduce(const rule& on_rule)
+                static action reduce(const item& on_item)
                 {
-                    return action(REDUCE, on_rule);
+                    return action(REDUCE, on_item.get_rule(), on_item.get_rule_index());
                 }
                 ACTION_TYPE get_type() const
                 {
@@ -184,6 +240,12 @@ namespace parser {
                         throw std::runtime_error("shouldn't get rule of a shift action");
                     return *on_rule;
                 }
+                uint get_rule_index() const
+                {
+                    if (type == SHIFT)
+                        throw std::runtime_error("shouldn't get rule of a shift action");
+                    return rule_index;
+                }
                 int get_precedence() const
                 {
                     return on_rule->get_precedence();
@@ -195,44 +257,144 @@ namespace parser {
 
             };
 
-            struct item_set : PARSER_PARAMS::template types<item>::set
+            //a resolved action as stored in a compiled table: the type is
+            //kept in the low two bits, the target state (for shift) or the
+            //rule index (for reduce) in the rest
+            struct table_action
             {
-                typedef typename PARSER_PARAMS::template types<item>::set set;
-                typedef typename set::const_iterator const_iterator;
+                uint packed;
+
+                table_action()
+                    :packed(INVALID_ACTION)
+                {}
+                table_action(ACTION_TYPE type, uint value)
+                    :packed((value << 2) | type)
+                {}
+                static table_action shift(uint state)
+                {
+                    return table_action(SHIFT, state);
+                }
+                static table_action reduce(uint rule_index)
+                {
+                    return table_action(REDUCE, rule_index);
+                }
+                ACTION_TYPE get_type() const
+                {
+                    return packed & 3;
+                }
+                uint get_value() const
+                {
+                    return packed >> 2;
+                }
+                bool operator==(const table_action& rh) const
+                {
+                    return packed == rh.packed;
+                }
+                bool operator!=(const table_action& rh) const
+                {
+                    return packed != rh.packed;
+                }
+            };
+
+            //items kept sorted and unique in a flat array, hashed once
+            //when the set is built
+            struct item_set
+            {
+                typedef typename PARSER_PARAMS::template types<item>::vector vector;
+                typedef typename vector::const_iterator const_iterator;
+                typedef const_iterator iterator;
+
+                vector items;
+                uint hash;
 
                 const_iterator begin() const
                 {
-                    return set::begin();
+                    return items.begin();
                 }
                 const_iterator end() const
                 {
-                    return set::end();
+                    return items.end();
+                }
+                uint size() const
+                {
+                    return items.size();
+                }
+                bool empty() const
+                {
+                    return items.empty();
+                }
+                uint get_hash() const
+                {
+                    return hash;
                 }
 
                 item_set()
+                    :hash(0)
                 {}
                 template <typename ITERATOR_TYPE>
                     item_set(ITERATOR_TYPE b, ITERATOR_TYPE e)
-                    :set(b, e)
-                    {}
+                    :items(b, e)
+                    {
+                        normalize();
+                    }
+                //takes the content of unsorted_items, leaving it empty
+                explicit item_set(vector& unsorted_items)
+                {
+                    items.swap(unsorted_items);
+                    normalize();
+                }
+                void insert(const item& new_item)
+                {
+                    typename vector::iterator position = std::lower_bound(items.begin(), items.end(), new_item);
+                    if (position != items.end() && *position == new_item)
+                        return;
+                    items.insert(position, new_item);
+                    rehash();
+                }
+                void normalize()
+                {
+                    std::sort(items.begin(), items.end());
+                    items.erase(std::unique(items.begin(), items.end()), items.end());
+                    rehash();
+                }
+                void rehash()
+                {
+                    hash = 2166136261u;
+                    for (const_iterator it = begin(); it != end(); ++it)
+                        hash = (hash ^ it->get_hash()) * 16777619u;
+                }
+                bool operator==(const item_set& rh) const
+                {
+                    return hash == rh.hash && items == rh.items;
+                }
+                bool operator!=(const item_set& rh) const
+                {
+                    return !(*this == rh);
+                }
                 template <typename CALLBACK_TYPE>
                     void enumerate_actions(const symbol &lookup_symbol, CALLBACK_TYPE &callback) const
                     {
                         const_iterator item;
                         for (item = begin(); item != end(); ++item) {
                             if (item->at_end())
-                                callback(action::reduce(item->get_rule()));
+                                callback(action::reduce(*item));
                             else
                                 if (item->next_symbol() == lookup_symbol)
-                                    callback(action::shift(item->get_rule()));
+                                    callback(action::shift(*item));
                         }
 
                     }
+                //resolves the actions it is fed by precedence and
+                //associativity; unresolvable conflicts throw, or, when
+                //throw_on_conflict is false, are recorded in conflict and
+                //settled the yacc way (shift wins, then the earlier rule)
                 struct get_action_callback
                 {
                     action result;
-                    get_action_callback()
-                        :result(action(INVALID_ACTION, 0))
+                    const char *conflict;
+                    bool throw_on_conflict;
+                    get_action_callback(bool throw_on_conflict = true)
+                        :result(action(INVALID_ACTION, 0)), conflict(0), throw_on_conflict(throw_on_conflict)
                     {}
                     void operator()(const action& new_action)
                     {
@@ -240,6 +402,12 @@ namespace parser {
                         if (result.get_type() == INVALID_ACTION) {
                             goto update;
                         }
+                        if (result.get_type() == SHIFT && new_action.get_type() == SHIFT) {
+                            //every shift on a symbol leads to the same state
+                            if (result.get_precedence() < new_action.get_precedence())
+                                goto update;
+                            return;
+                        }
                         if (result.get_precedence() > new_action.get_precedence())
                             return;
                         if (result.get_precedence() < new_action.get_precedence()) {
@@ -272,7 +440,13 @@ update:
                         result = new_action;
                         return;
 conflict:
-                        throw std::runtime_error(message);
+                        if (throw_on_conflict)
+                            throw std::runtime_error(message);
+                        if (!conflict)
+                            conflict = message;
+                        if (new_action.get_type() == SHIFT ||
+                                (result.get_type() == REDUCE && new_action.get_rule_index() < result.get_rule_index()))
+                            result = new_action;
 
                     }
                 };
@@ -289,6 +463,63 @@ conflict:
                 }
             };
             typedef typename PARSER_PARAMS::template types<item_set>::vector item_set_list;
+
+            //open addressing index from item sets to the ids of the states
+            //holding them; the item sets themselves are stored by the caller
+            //and reached through a STATE_LOOKUP functor mapping id to set
+            struct state_index
+            {
+                typename types<uint>::vector buckets;//id + 1, 0 when empty
+                uint count;
+
+                state_index()
+                    :count(0)
+                {}
+                void clear()
+                {
+                    buckets.clear();
+                    count = 0;
+                }
+                //returns uint(-1) if state is not indexed
+                template <typename STATE_LOOKUP>
+                    uint find(const item_set& state, const STATE_LOOKUP& lookup) const
+                    {
+                        if (buckets.empty())
+                            return uint(-1);
+                        uint mask = buckets.size() - 1;
+                        for (uint i = state.get_hash() & mask; buckets[i]; i = (i + 1) & mask) {
+                            if (lookup(buckets[i] - 1) == state)
+                                return buckets[i] - 1;
+                        }
+                        return uint(-1);
+                    }
+                template <typename STATE_LOOKUP>
+                    void insert(const item_set& state, uint id, const STATE_LOOKUP& lookup)
+                    {
+                        if (2 * (count + 1) > buckets.size())
+                            grow(lookup);
+                        place(state.get_hash(), id);
+                        ++count;
+                    }
+                void place(uint hash, uint id)
+                {
+                    uint mask = buckets.size() - 1;
+                    uint i = hash & mask;
+                    while (buckets[i])
+                        i = (i + 1) & mask;
+                    buckets[i] = id + 1;
+                }
+                template <typename STATE_LOOKUP>
+                    void grow(const STATE_LOOKUP& lookup)
+                    {
+                        typename types<uint>::vector old_buckets;
+                        old_buckets.swap(buckets);
+                        buckets.assign(old_buckets.empty() ? 16 : 2 * old_buckets.size(), 0);
+                        for (uint i = 0; i < old_buckets.size(); ++i)
+                            if (old_buckets[i])
+                                place(lookup(old_buckets[i] - 1).get_hash(), old_buckets[i] - 1);
+                    }
+            };
         };
 
 #ifndef DONT_DEFINE_PARSER_DEFAULT
@@ -323,6 +554,282 @@ conflict:
 
     };
 #endif
+    //the statistics policy of the contexts: every hook is an empty inline
+    //function, so a context without statistics does not pay for them. See
+    //parser-stats.hpp for one that counts.
+    struct no_stats
+    {
+        void on_shift(unsigned int /*state*/, size_t /*depth*/) {}
+        void on_reduce(unsigned int /*rule_index*/, size_t /*depth*/) {}
+        void on_value() {}
+        void on_cache_hit() {}
+        void on_cache_miss() {}
+        void on_next() {}
+        void on_closure() {}
+        void on_syntax_error() {}
+        void phase(const char* /*name*/) {}
+    };
+    //automatons that can report cache statistics overload these
+    template <typename AUTOMATON, typename STATS>
+        inline typename AUTOMATON::table_action lookup_action(const AUTOMATON& automaton,
+                typename AUTOMATON::state state, const typename AUTOMATON::symbol& s, STATS&)
+        {
+            return automaton.get_action(state, s);
+        }
+    template <typename AUTOMATON, typename STATS>
+        inline typename AUTOMATON::state lookup_goto(const AUTOMATON& automaton,
+                typename AUTOMATON::state state, const typename AUTOMATON::symbol& s, STATS&)
+        {
+            return automaton.get_goto(state, s);
+        }
+
+    //drives a parse over any automaton that exposes integer states (of type
+    //AUTOMATON::state) through get_action(state, symbol),
+    //get_goto(state, symbol) and get_rule(index); get_goto returns
+    //AUTOMATON::invalid_state where there is no goto, as for the start
+    //symbol of a compiled table, and the token is then a syntax error as
+    //if it had no action. The stacks come from
+    //STACK_TYPES::types<T>::indexed_stack (the automaton's by default).
+    //Tokens are only ever moved, so TOKEN_TYPE may be move-only: reduce
+    //callbacks get iterators to the right hand side tokens, may move out
+    //of them, and their result is moved into the slot of the first one.
+    //STATS receives the hooks of no_stats.
+    //feed_symbol throws on a syntax error; try_feed_symbol returns a
+    //PARSE_STATUS instead and, once set_error_symbol names the grammar's
+    //error symbol, recovers the way yacc does: it pops states until one
+    //shifts the error symbol, shifts TOKEN_TYPE(error symbol) and then
+    //drops tokens until one can be parsed. New errors are not reported
+    //until three tokens have been shifted.
+    template <typename AUTOMATON, typename TOKEN_TYPE, typename STACK_TYPES = AUTOMATON, typename STATS = no_stats>
+        struct basic_context
+        {
+            typedef AUTOMATON automaton_type;
+            typedef TOKEN_TYPE token_type;
+            typedef typename AUTOMATON::uint uint;
+            typedef typename AUTOMATON::state state;
+            typedef typename AUTOMATON::symbol symbol;
+            typedef typename AUTOMATON::rule rule;
+            typedef typename AUTOMATON::table_action table_action;
+
+            const AUTOMATON* automaton;
+            typename STACK_TYPES::template types<state>::indexed_stack parse_stack;
+            typename STACK_TYPES::template types<TOKEN_TYPE>::indexed_stack token_stack;
+            STATS stats;
+            symbol error_symbol;
+            bool has_error_symbol;
+            uint recovering;//tokens to shift before errors are reported again
+            uint error_count;
+
+            basic_context(const AUTOMATON& automaton, state initial_state)
+                :automaton(&automaton), error_symbol(), has_error_symbol(false), recovering(0), error_count(0)
+            {
+                parse_stack.push_back(initial_state);
+            }
+            void set_error_symbol(const symbol& s)
+            {
+                error_symbol = s;
+                has_error_symbol = true;
+            }
+            //makes room for a parse this deep, so that it does not allocate
+            void reserve(uint depth)
+            {
+                parse_stack.reserve(depth + 1);
+                token_stack.reserve(depth);
+            }
+            //back to the initial state with no tokens; the stacks keep
+            //their storage
+            void reset()
+            {
+                parse_stack.pop(parse_stack.size() - 1);
+                token_stack.pop(token_stack.size());
+                recovering = 0;
+                error_count = 0;
+            }
+            struct default_action
+            {
+                template <typename TOKEN_ITERATOR>
+                    TOKEN_TYPE operator()(const rule& rule, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                    {
+                        return TOKEN_TYPE(rule, begin, end);
+                    }
+            };
+            void feed_symbol(const TOKEN_TYPE& lookup_token)
+            {
+                feed_symbol(lookup_token, default_action());
+            }
+            void feed_symbol(TOKEN_TYPE&& lookup_token)
+            {
+                feed_symbol(std::move(lookup_token), default_action());
+            }
+            template <typename REDUCE_CALLBACK>
+                void feed_symbol(const TOKEN_TYPE& lookup_token, REDUCE_CALLBACK callback)
+                {
+                    parse_stack.push_back(reduce_to_shift(lookup_token.get_symbol(), callback));
+                    stats.on_shift(parse_stack.back(), parse_stack.size());
+                    token_stack.push_back(lookup_token);
+                }
+            template <typename REDUCE_CALLBACK>
+                void feed_symbol(TOKEN_TYPE&& lookup_token, REDUCE_CALLBACK callback)
+                {
+                    parse_stack.push_back(reduce_to_shift(lookup_token.get_symbol(), callback));
+                    stats.on_shift(parse_stack.back(), parse_stack.size());
+                    token_stack.push_back(std::move(lookup_token));
+                }
+            PARSE_STATUS try_feed_symbol(const TOKEN_TYPE& lookup_token)
+            {
+                default_action callback;
+                return try_feed(lookup_token, callback);
+            }
+            PARSE_STATUS try_feed_symbol(TOKEN_TYPE&& lookup_token)
+            {
+                default_action callback;
+                return try_feed(std::move(lookup_token), callback);
+            }
+            template <typename REDUCE_CALLBACK>
+                PARSE_STATUS try_feed_symbol(const TOKEN_TYPE& lookup_token, REDUCE_CALLBACK callback)
+                {
+                    return try_feed(lookup_token, callback);
+                }
+            template <typename REDUCE_CALLBACK>
+                PARSE_STATUS try_feed_symbol(TOKEN_TYPE&& lookup_token, REDUCE_CALLBACK callback)
+                {
+                    return try_feed(std::move(lookup_token), callback);
+                }
+            template <typename TOKEN_REFERENCE, typename REDUCE_CALLBACK>
+                PARSE_STATUS try_feed(TOKEN_REFERENCE&& lookup_token, REDUCE_CALLBACK& callback)
+                {
+                    const symbol lookup = lookup_token.get_symbol();
+                    PARSE_STATUS status = PARSE_OK;
+                    for(;;) {
+                        table_action needed_action = lookup_action(*automaton, parse_stack.back(), lookup, stats);
+                        switch(needed_action.get_type()) {
+                            case SHIFT:
+                                parse_stack.push_back(needed_action.get_value());
+                                stats.on_shift(parse_stack.back(), parse_stack.size());
+                                token_stack.push_back(std::forward<TOKEN_REFERENCE>(lookup_token));
+                                if (recovering)
+                                    --recovering;
+                                return status;
+                            case REDUCE:
+                                if (reduce(needed_action.get_value(), callback) != AUTOMATON::invalid_state)
+                                    break;
+                                //nothing to go to, which is a syntax error
+                                //fall through
+                            case INVALID_ACTION:
+                                //the error symbol was just shifted and this token
+                                //does not follow it either
+                                if (recovering == 3)
+                                    return status == PARSE_OK ? PARSE_DISCARDED : status;
+                                if (!recovering) {
+                                    ++error_count;
+                                    stats.on_syntax_error();
+                                    status = PARSE_ERROR;
+                                }
+                                if (!shift_error_symbol())
+                                    return PARSE_FAILED;
+                                break;
+                        }
+                    }
+                }
+            //pops states until one shifts the error symbol and shifts it
+            bool shift_error_symbol()
+            {
+                if (!has_error_symbol)
+                    return false;
+                for (;;) {
+                    table_action on_error = lookup_action(*automaton, parse_stack.back(), error_symbol, stats);
+                    if (on_error.get_type() == SHIFT) {
+                        parse_stack.push_back(on_error.get_value());
+                        token_stack.push_back(TOKEN_TYPE(error_symbol));
+                        recovering = 3;
+                        return true;
+                    }
+                    if (parse_stack.size() == 1)
+                        return false;
+                    parse_stack.pop();
+                    token_stack.pop();
+                }
+            }
+            template <typename TOKEN_ITERATOR>
+                TOKEN_ITERATOR feed_symbols(TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
+                {
+                    return feed_symbols(begin, end, default_action());
+                }
+            //feeds a whole range of tokens, moving them onto the token stack.
+            //Returns the position of the first token that has no action (the
+            //tokens before it are consumed), or end if all of them were.
+            template <typename TOKEN_ITERATOR, typename REDUCE_CALLBACK>
+                TOKEN_ITERATOR feed_symbols(TOKEN_ITERATOR begin, TOKEN_ITERATOR end, REDUCE_CALLBACK callback)
+                {
+                    const AUTOMATON& table = *automaton;
+                    state current = parse_stack.back();
+                    for (; begin != end; ++begin) {
+                        const symbol lookup = begin->get_symbol();
+                        for (;;) {
+                            table_action needed_action = lookup_action(table, current, lookup, stats);
+                            if (needed_action.get_type() == SHIFT) {
+                                current = needed_action.get_value();
+                                parse_stack.push_back(current);
+                                stats.on_shift(current, parse_stack.size());
+                                token_stack.push_back(std::move(*begin));
+                                break;
+                            }
+                            if (needed_action.get_type() != REDUCE)
+                                return begin;
+                            current = reduce(needed_action.get_value(), callback);
+                            if (current == AUTOMATON::invalid_state)
+                                return begin;
+                        }
+                    }
+                    return end;
+                }
+            //does the reductions lookup calls for and returns the state to
+            //shift it to
+            template <typename REDUCE_CALLBACK>
+                state reduce_to_shift(const symbol& lookup, REDUCE_CALLBACK& callback)
+                {
+                    for(;;) {
+                        table_action needed_action = lookup_action(*automaton, parse_stack.back(), lookup, stats);
+                        switch(needed_action.get_type()) {
+                            case INVALID_ACTION:
+                                throw std::runtime_error("syntax error");
+                            case SHIFT:
+                                return needed_action.get_value();
+                            case REDUCE:
+                                if (reduce(needed_action.get_value(), callback) == AUTOMATON::invalid_state)
+                                    throw std::runtime_error("syntax error");
+                                break;
+                        }
+                    }
+                }
+            //replaces the right hand side of the rule on top of the stacks
+            //with the callback's value, returns the new top state. Returns
+            //AUTOMATON::invalid_state without calling the callback or
+            //touching the stacks if the left hand side has no goto.
+            template <typename REDUCE_CALLBACK>
+                state reduce(uint rule_index, REDUCE_CALLBACK& callback)
+                {
+                    const rule& reduced = automaton->get_rule(rule_index);
+                    uint num_tokens = reduced.size();
+                    state next = lookup_goto(*automaton, *(parse_stack.end() - num_tokens - 1), reduced.get_left_hand(), stats);
+                    if (next == AUTOMATON::invalid_state)
+                        return next;
+                    TOKEN_TYPE new_token =
+                        callback(reduced, token_stack.end() - num_tokens, token_stack.end());
+                    stats.on_value();
+                    if (num_tokens) {
+                        *(token_stack.end() - num_tokens) = std::move(new_token);
+                        token_stack.pop(num_tokens - 1);
+                        parse_stack.pop(num_tokens);
+                    } else {
+                        token_stack.push_back(std::move(new_token));
+                    }
+                    parse_stack.push_back(next);
+                    stats.on_reduce(rule_index, parse_stack.size());
+                    return next;
+                }
+        };
+
     template <typename PARSER_IMPL>
         struct parser : PARSER_IMPL
     {
@@ -335,9 +842,13 @@ conflict:
         typedef typename PARSER_IMPL::symbol_iterator symbol_iterator;   
         typedef typename PARSER_IMPL::item_set_list item_set_list;
         typedef typename PARSER_IMPL::action action;
+        typedef typename PARSER_IMPL::table_action table_action;
+        typedef uint state;
         template <typename T>
             struct types : PARSER_IMPL::template types<T>{};
 
+        static const uint invalid_state = uint(-1);
+
         rule_iterator begin_rules() const
         {
             return PARSER_IMPL::begin_rules();
@@ -356,133 +867,1382 @@ conflict:
         }
 
 
-        template <typename TOKEN_TYPE> 
-            struct context
+        //maps symbols to their position in begin_symbols() order
+        struct column_map
+        {
+            typedef std::pair<symbol, uint> entry;
+            typename types<symbol>::vector columns;
+            typename types<entry>::vector index;//sorted by symbol
+
+            template <typename ITERATOR>
+                void assign(ITERATOR begin, ITERATOR end)
             {
-                const parser* active_parser;
-                typename types<item_set>::indexed_stack parse_stack;
-                typename types<TOKEN_TYPE>::indexed_stack token_stack;
-                context(const parser &active_parser, const symbol& initial_symbol)
-                    :active_parser(&active_parser)
-                {                                   
-                    parse_stack.push_back(active_parser.symbol2state(initial_symbol));
-                }
+                columns.assign(begin, end);
+                index.clear();
+                for (uint i = 0; i < columns.size(); ++i)
+                    index.push_back(entry(columns[i], i));
+                std::sort(index.begin(), index.end());
+            }
+            void clear()
+            {
+                columns.clear();
+                index.clear();
+            }
+            uint size() const
+            {
+                return columns.size();
+            }
+            const symbol& operator[](uint column) const
+            {
+                return columns[column];
+            }
+            //returns size() for symbols outside of the grammar
+            uint get_column(const symbol& s) const
+            {
+                typename types<entry>::vector::const_iterator found =
+                    std::lower_bound(index.begin(), index.end(), entry(s, 0));
+                if (found == index.end() || found->first != s)
+                    return size();
+                return found->second;
+            }
+        };
 
-                context(const parser &active_parser, const item_set& initial_state)
-                    :active_parser(&active_parser), parse_stack(1, initial_state)
+        //facts derived once from the rules and symbols: a column for every
+        //symbol (declared ones first, then any others the rules use), the
+        //rules grouped by left hand and, per symbol, a bitset of the rules
+        //whose initial items its transitive closure adds
+        struct grammar_analysis
+        {
+            column_map columns;
+            typename types<uint>::vector rules_by_left_hand;
+            typename types<uint>::vector left_hand_begin;//column -> first index into rules_by_left_hand
+            typename types<uint>::vector closures;//column -> words_per_set words
+            uint words_per_set;
+            std::atomic<bool> ready;
+            std::mutex mutex;
+
+            grammar_analysis()
+                :words_per_set(0), ready(false)
+            {}
+            grammar_analysis(const grammar_analysis&)
+                :words_per_set(0), ready(false)
+            {}
+            grammar_analysis& operator=(const grammar_analysis&)
+            {
+                clear();
+                return *this;
+            }
+            void clear()
+            {
+                columns.clear();
+                rules_by_left_hand.clear();
+                left_hand_begin.clear();
+                closures.clear();
+                words_per_set = 0;
+                ready.store(false, std::memory_order_relaxed);
+            }
+            const uint* get_closure(uint column) const
+            {
+                return &closures[column * words_per_set];
+            }
+            bool has_rules(uint column) const
+            {
+                return left_hand_begin[column] != left_hand_begin[column + 1];
+            }
+        };
+
+        //item sets interned on demand together with the actions and
+        //transitions found from them. Known transitions are read with a
+        //single atomic load, so contexts on different threads can share a
+        //parser; only interning a new item set takes the mutex.
+        struct state_cache
+        {
+            enum {
+                FIRST_SEGMENT_SIZE = 64,
+                SEGMENT_COUNT = 26
+            };
+            static const uint unknown_action = 3;//no ACTION_TYPE uses it
+            static const uint unknown_state = uint(-2);
+
+            struct entry
+            {
+                item_set items;
+                std::atomic<uint>* cells;//actions, then gotos, per analysis column
+
+                entry()
+                    :cells(0)
+                {}
+                ~entry()
                 {
+                    delete[] cells;
                 }
-                struct default_action
+            };
+
+            std::atomic<entry*> segments[SEGMENT_COUNT];
+            std::atomic<uint> count;
+            typename PARSER_IMPL::state_index index;
+            std::mutex mutex;
+
+            state_cache()
+            {
+                init();
+            }
+            state_cache(const state_cache&)
+            {
+                init();
+            }
+            state_cache& operator=(const state_cache&)
+            {
+                clear();
+                return *this;
+            }
+            ~state_cache()
+            {
+                clear();
+            }
+            void init()
+            {
+                for (uint i = 0; i < SEGMENT_COUNT; ++i)
+                    segments[i].store(0, std::memory_order_relaxed);
+                count.store(0, std::memory_order_relaxed);
+            }
+            void clear()
+            {
+                for (uint i = 0; i < SEGMENT_COUNT; ++i)
+                    delete[] segments[i].load(std::memory_order_relaxed);
+                init();
+                index.clear();
+            }
+            //segment k holds FIRST_SEGMENT_SIZE << k entries, so entries
+            //never move once created
+            static uint locate(uint state, uint &offset)
+            {
+                uint segment = highest_bit(state / FIRST_SEGMENT_SIZE + 1);
+                offset = state - FIRST_SEGMENT_SIZE * ((1u << segment) - 1);
+                return segment;
+            }
+            entry& at(uint state) const
+            {
+                uint offset;
+                uint segment = locate(state, offset);
+                return segments[segment].load(std::memory_order_acquire)[offset];
+            }
+            //must be called with the mutex held
+            entry& append()
+            {
+                uint offset;
+                uint segment = locate(count.load(std::memory_order_relaxed), offset);
+                if (offset == 0)
+                    segments[segment].store(new entry[FIRST_SEGMENT_SIZE << segment], std::memory_order_release);
+                return segments[segment].load(std::memory_order_relaxed)[offset];
+            }
+        };
+
+        template <typename TOKEN_TYPE, typename STACK_TYPES = parser, typename STATS = no_stats>
+            struct context : basic_context<parser, TOKEN_TYPE, STACK_TYPES, STATS>
+            {
+                context(const parser &active_parser, const symbol& initial_symbol)
+                    :basic_context<parser, TOKEN_TYPE, STACK_TYPES, STATS>(active_parser, active_parser.get_initial_state(initial_symbol))
                 {
-                    template <typename TOKEN_ITERATOR>
-                        TOKEN_TYPE operator()(const rule& rule, TOKEN_ITERATOR begin, TOKEN_ITERATOR end)
-                        {
-                            return TOKEN_TYPE(rule, begin, end);
-                        }
-                };
-                void feed_symbol(const TOKEN_TYPE& lookup_token)
+                }
+
+                context(const parser &active_parser, const item_set& initial_state)
+                    :basic_context<parser, TOKEN_TYPE, STACK_TYPES, STATS>(active_parser, active_parser.intern(initial_state))
                 {
-                    //                   printf("lookup = %c\n", lookup_token.get_symbol());
-                    feed_symbol(lookup_token, default_action());
                 }
-                template <typename REDUCE_CALLBACK>
-                    void feed_symbol(const TOKEN_TYPE& lookup_token, REDUCE_CALLBACK callback)
-                    {
-                        for(;;) {
-                            const item_set& top = parse_stack.back();
-                            const symbol& lookup = lookup_token.get_symbol();
-                            action needed_action = top.get_action(lookup);
-                            switch(needed_action.get_type()) {
-                                case INVALID_ACTION:
-                                    throw std::runtime_error("syntax error");
-                                case SHIFT:
-                                    parse_stack.push_back(active_parser->next(top, lookup));
-                                    token_stack.push_back(lookup_token);
-                                    return;
-                                case REDUCE:
-                                    uint num_tokens = needed_action.get_rule().size();
-                                    TOKEN_TYPE new_token = 
-                                        callback(needed_action.get_rule(), token_stack.end() - num_tokens, token_stack.end());
-                                    parse_stack.pop(num_tokens);
-                                    token_stack.pop(num_tokens);
-                                    const item_set &current_top = parse_stack.back();
-                                    const item_set new_top = active_parser->next(current_top, needed_action.get_rule().get_left_hand());
-                                    parse_stack.push_back(new_top);
-                                    token_stack.push_back(new_token);
-                                    break;
-                            }
-                        }
+            };
 
+        //returns the id of state, adding it to the cache if it is new
+        uint intern(const item_set& state) const
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            uint found = cache.index.find(state, cache_lookup(cache));
+            if (found != invalid_state)
+                return found;
+            uint id = cache.count.load(std::memory_order_relaxed);
+            typename state_cache::entry& new_entry = cache.append();
+            uint width = get_analysis().columns.size();
+            new_entry.items = state;
+            new_entry.cells = new std::atomic<uint>[2 * width];
+            for (uint i = 0; i < width; ++i) {
+                new_entry.cells[i].store(state_cache::unknown_action, std::memory_order_relaxed);
+                new_entry.cells[width + i].store(state_cache::unknown_state, std::memory_order_relaxed);
+            }
+            cache.index.insert(state, id, cache_lookup(cache));
+            cache.count.store(id + 1, std::memory_order_release);
+            return id;
+        }
+        const item_set& get_state(uint state) const
+        {
+            return cache.at(state).items;
+        }
+        uint state_count() const
+        {
+            return cache.count.load(std::memory_order_acquire);
+        }
+        uint get_initial_state(const symbol& start_symbol) const
+        {
+            return intern(symbol2state(start_symbol));
+        }
+        table_action get_action(uint state, const symbol& lookup_symbol) const
+        {
+            no_stats stats;
+            return get_action(state, lookup_symbol, stats);
+        }
+        uint get_goto(uint state, const symbol& s) const
+        {
+            no_stats stats;
+            return get_goto(state, s, stats);
+        }
+        //the same lookups, reporting cache hits and misses and the
+        //successor states computed to stats. invalid_state has no
+        //actions and no gotos.
+        template <typename STATS>
+            table_action get_action(uint state, const symbol& lookup_symbol, STATS& stats) const
+            {
+                const column_map& columns = get_analysis().columns;
+                uint column = columns.get_column(lookup_symbol);
+                if (column == columns.size() || state == invalid_state)
+                    return table_action();
+                std::atomic<uint>& cell = cache.at(state).cells[column];
+                table_action rez;
+                rez.packed = cell.load(std::memory_order_acquire);
+                if (rez.packed != state_cache::unknown_action) {
+                    stats.on_cache_hit();
+                    return rez;
+                }
+                stats.on_cache_miss();
+                action needed_action = get_state(state).get_action(lookup_symbol);
+                switch (needed_action.get_type()) {
+                    case INVALID_ACTION:
+                        rez = table_action();
+                        break;
+                    case SHIFT: {
+                        //the goto cell is filled on the way, but not counted
+                        //as a second lookup
+                        std::atomic<uint>& goto_cell = cache.at(state).cells[columns.size() + column];
+                        uint target = goto_cell.load(std::memory_order_acquire);
+                        if (target == state_cache::unknown_state)
+                            target = fill_goto(state, lookup_symbol, goto_cell, stats);
+                        rez = table_action::shift(target);
+                        break;
                     }
-            };
+                    case REDUCE:
+                        rez = table_action::reduce(needed_action.get_rule_index());
+                        break;
+                }
+                cell.store(rez.packed, std::memory_order_release);
+                return rez;
+            }
+        template <typename STATS>
+            uint get_goto(uint state, const symbol& s, STATS& stats) const
+            {
+                const column_map& columns = get_analysis().columns;
+                uint column = columns.get_column(s);
+                if (column == columns.size() || state == invalid_state)
+                    return invalid_state;
+                std::atomic<uint>& cell = cache.at(state).cells[columns.size() + column];
+                uint target = cell.load(std::memory_order_acquire);
+                if (target != state_cache::unknown_state) {
+                    stats.on_cache_hit();
+                    return target;
+                }
+                stats.on_cache_miss();
+                return fill_goto(state, s, cell, stats);
+            }
+        //computes the goto of state on s into its cache cell, counting
+        //the successor state but no cache lookup
+        template <typename STATS>
+            uint fill_goto(uint state, const symbol& s, std::atomic<uint>& cell, STATS& stats) const
+            {
+                stats.on_next();
+                item_set next_state = next(get_state(state), s, stats);
+                uint target = next_state.empty() ? invalid_state : intern(next_state);
+                cell.store(target, std::memory_order_release);
+                return target;
+            }
+        const rule& get_rule(uint rule_index) const
+        {
+            return begin_rules()[rule_index];
+        }
+        //forgets every interned state; needed after rules or symbols change.
+        //Must not run concurrently with contexts using this parser
+        void clear_cache()
+        {
+            cache.clear();
+            analysis.clear();
+        }
+
         item_set next(const item_set& old_set, const symbol& symbol) const
         {
-            item_set pre_rez;
-            for(typename item_set::const_iterator it = old_set.begin();
-                    it != old_set.end();
-                    ++it)
-                if (it->can_progress(symbol))
-                    pre_rez.insert(it->next());
-            return closure(pre_rez);
+            no_stats stats;
+            return next(old_set, symbol, stats);
         }
-        item_set closure(const item_set& set) const
+        template <typename STATS>
+            item_set next(const item_set& old_set, const symbol& symbol, STATS& stats) const
+            {
+                typename types<item>::vector pre_rez;
+                for(typename item_set::const_iterator it = old_set.begin();
+                        it != old_set.end();
+                        ++it)
+                    if (it->can_progress(symbol))
+                        pre_rez.push_back(it->next());
+                stats.on_closure();
+                return closure(item_set(pre_rez));
+            }
+        const grammar_analysis& get_analysis() const
         {
-            item_set rez(set.begin(), set.end());
+            if (!analysis.ready.load(std::memory_order_acquire)) {
+                std::lock_guard<std::mutex> lock(analysis.mutex);
+                if (!analysis.ready.load(std::memory_order_relaxed)) {
+                    analyze(analysis);
+                    analysis.ready.store(true, std::memory_order_release);
+                }
+            }
+            return analysis;
+        }
+        void analyze(grammar_analysis& rez) const
+        {
+            typename types<symbol>::vector all_symbols(begin_symbols(), end_symbols());
+            {
+                column_map declared;
+                declared.assign(all_symbols.begin(), all_symbols.end());
+                typename types<symbol>::vector used;
+                for (rule_iterator rule_element = begin_rules(); rule_element != end_rules(); ++rule_element) {
+                    used.push_back(rule_element->get_left_hand());
+                    used.insert(used.end(), rule_element->begin(), rule_element->end());
+                }
+                std::sort(used.begin(), used.end());
+                used.erase(std::unique(used.begin(), used.end()), used.end());
+                for (uint i = 0; i < used.size(); ++i)
+                    if (declared.get_column(used[i]) == declared.size())
+                        all_symbols.push_back(used[i]);
+            }
+            rez.columns.assign(all_symbols.begin(), all_symbols.end());
+            uint width = rez.columns.size();
+            uint rule_count = end_rules() - begin_rules();
 
+            rez.left_hand_begin.assign(width + 1, 0);
+            for (uint i = 0; i < rule_count; ++i)
+                ++rez.left_hand_begin[rez.columns.get_column(begin_rules()[i].get_left_hand()) + 1];
+            for (uint i = 0; i < width; ++i)
+                rez.left_hand_begin[i + 1] += rez.left_hand_begin[i];
+            {
+                typename types<uint>::vector position(rez.left_hand_begin.begin(), rez.left_hand_begin.end() - 1);
+                rez.rules_by_left_hand.resize(rule_count);
+                for (uint i = 0; i < rule_count; ++i)
+                    rez.rules_by_left_hand[position[rez.columns.get_column(begin_rules()[i].get_left_hand())]++] = i;
+            }
+
+            rez.words_per_set = (rule_count + 31) / 32;
+            rez.closures.assign(width * rez.words_per_set, 0);
+            typename types<uint>::vector pending;
+            typename types<char>::vector visited;
+            for (uint column = 0; column < width; ++column) {
+                if (!rez.has_rules(column))
+                    continue;
+                uint *row = &rez.closures[column * rez.words_per_set];
+                visited.assign(width, 0);
+                visited[column] = 1;
+                pending.push_back(column);
+                while (!pending.empty()) {
+                    uint current = pending.back();
+                    pending.pop_back();
+                    for (uint i = rez.left_hand_begin[current]; i < rez.left_hand_begin[current + 1]; ++i) {
+                        uint rule_index = rez.rules_by_left_hand[i];
+                        const rule& current_rule = begin_rules()[rule_index];
+                        row[rule_index / 32] |= 1u << (rule_index % 32);
+                        if (current_rule.empty())
+                            continue;
+                        uint first = rez.columns.get_column(current_rule[0]);
+                        if (!visited[first] && rez.has_rules(first)) {
+                            visited[first] = 1;
+                            pending.push_back(first);
+                        }
+                    }
+                }
+            }
+        }
+        //adds the initial item of every rule in the bitset
+        void append_initial_items(const typename types<uint>::vector& rule_set, typename types<item>::vector& items) const
+        {
+            for (uint word = 0; word < rule_set.size(); ++word) {
+                for (uint bits = rule_set[word]; bits; bits &= bits - 1) {
+                    uint rule_index = word * 32 + lowest_bit(bits);
+                    items.push_back(item(rule_index, begin_rules()[rule_index]));
+                }
+            }
+        }
+        item_set closure(const item_set& set) const
+        {
+            const grammar_analysis& grammar = get_analysis();
+            typename types<uint>::vector added(grammar.words_per_set, 0);
             for (typename item_set::const_iterator original_set_element = set.begin();
                     original_set_element != set.end();
                     ++original_set_element) {
                 if (original_set_element->at_end())
                     continue;
-                symbol required_symbol = original_set_element->next_symbol();
-                for (rule_iterator rule_element = begin_rules();
-                        rule_element != end_rules();
-                        ++rule_element) {
-                    if (rule_element->get_left_hand() == required_symbol)
-                        rez.insert(item(*rule_element));
-                }
+                uint column = grammar.columns.get_column(original_set_element->next_symbol());
+                const uint* row = grammar.get_closure(column);
+                for (uint i = 0; i < grammar.words_per_set; ++i)
+                    added[i] |= row[i];
             }
-            return rez;
+            typename types<item>::vector rez(set.begin(), set.end());
+            append_initial_items(added, rez);
+            return item_set(rez);
         }
         item_set symbol2state(const symbol &start_symbol)const
         {
-            item_set initial_state;
-            for (rule_iterator rule_element = begin_rules();
-                    rule_element != end_rules();
-                    ++rule_element) {
-                if (rule_element->get_left_hand() == start_symbol)
-                    initial_state.insert(item(*rule_element));
-            }
-            return closure(initial_state);
+            const grammar_analysis& grammar = get_analysis();
+            uint column = grammar.columns.get_column(start_symbol);
+            if (column == grammar.columns.size())
+                return item_set();
+            const uint* row = grammar.get_closure(column);
+            typename types<item>::vector initial_state;
+            append_initial_items(typename types<uint>::vector(row, row + grammar.words_per_set), initial_state);
+            return item_set(initial_state);
         }
-        item_set_list generate_states(const symbol& start_symbol)
+        struct graph_lookup
         {
-            item_set_list graph;
+            const item_set_list* graph;
+            graph_lookup(const item_set_list& graph)
+                :graph(&graph)
+            {}
+            const item_set& operator()(uint state) const
+            {
+                return (*graph)[state];
+            }
+        };
+        struct cache_lookup
+        {
+            const state_cache* cache;
+            cache_lookup(const state_cache& cache)
+                :cache(&cache)
+            {}
+            const item_set& operator()(uint state) const
+            {
+                return cache->at(state).items;
+            }
+        };
+        //builds every reachable non-empty state; transitions receives, for
+        //each state, one entry per column of the grammar analysis holding
+        //the index of the successor state or invalid_state
+        void generate_states(const symbol& start_symbol, item_set_list& graph, typename types<uint>::vector& transitions,
+                uint thread_count = 1) const
+        {
+            if (thread_count != 1) {
+                generate_states_parallel(start_symbol, graph, transitions, thread_count);
+                return;
+            }
+            graph.clear();
+            transitions.clear();
             {
                 item_set initial_state = symbol2state(start_symbol);
                 if (initial_state.empty())
                     throw std::runtime_error("initial state is empty item set");
-                graph.push_back(closure(initial_state));
+                graph.push_back(initial_state);
             }
+            const column_map& columns = get_analysis().columns;
+            typename PARSER_IMPL::state_index index;
+            index.insert(graph.back(), 0, graph_lookup(graph));
             for (uint i = 0; i < graph.size(); ++i) {
-                for (symbol_iterator next_symbol = begin_symbols(); 
-                        next_symbol != end_symbols();
-                        ++next_symbol) {
-                    item_set new_state;
-                    for (typename item_set::iterator item_to_try = graph[i].begin();
-                            item_to_try != graph[i].end();
-                            ++item_to_try) {
-                        if (item_to_try->can_progress(*next_symbol))
-                            new_state.insert(item_to_try->next());
-                    }
-                    new_state = closure(new_state);
-                    if (std::find(graph.begin(), graph.end(), new_state) == graph.end())
+                for (uint column = 0; column < columns.size(); ++column) {
+                    item_set new_state = next(graph[i], columns[column]);
+                    if (new_state.empty()) {
+                        transitions.push_back(invalid_state);
+                        continue;
+                    }
+                    uint found = index.find(new_state, graph_lookup(graph));
+                    if (found == invalid_state) {
+                        found = graph.size();
                         graph.push_back(new_state);
+                        index.insert(graph.back(), found, graph_lookup(graph));
+                    }
+                    transitions.push_back(found);
                 }
             }
+        }
+        //computes the successors of a range of states for every column;
+        //the workers claim chunks of the range from a shared cursor
+        struct successor_worker
+        {
+            enum { CHUNK_SIZE = 16 };
+            const parser* owner;
+            const item_set_list* graph;
+            uint begin, end;
+            std::atomic<uint>* cursor;
+            item_set* successors;//(end - begin) * column count
+            std::mutex* failure_mutex;
+            std::exception_ptr* failure;
+
+            void operator()() const
+            {
+                try {
+                    const column_map& columns = owner->get_analysis().columns;
+                    uint width = columns.size();
+                    for (;;) {
+                        uint first = cursor->fetch_add(CHUNK_SIZE, std::memory_order_relaxed);
+                        if (first >= end - begin)
+                            return;
+                        uint last = std::min<uint>(first + CHUNK_SIZE, end - begin);
+                        for (uint i = first; i < last; ++i)
+                            for (uint column = 0; column < width; ++column)
+                                successors[i * width + column] = owner->next((*graph)[begin + i], columns[column]);
+                    }
+                } catch (...) {
+                    fail();
+                }
+            }
+            //stops the other workers and keeps the first exception
+            void fail() const
+            {
+                cursor->store(end - begin, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(*failure_mutex);
+                if (!*failure)
+                    *failure = std::current_exception();
+            }
+        };
+        //generate_states with the successors computed on thread_count
+        //threads (0 for one per core). States are expanded in batches taken
+        //in BFS order and the successors of a batch are numbered in (state,
+        //column) order, so the states and transitions are the same as the
+        //serial build's.
+        void generate_states_parallel(const symbol& start_symbol, item_set_list& graph, typename types<uint>::vector& transitions,
+                uint thread_count = 0) const
+        {
+            enum { BATCH_SIZE = 1024 };
+            if (!thread_count)
+                thread_count = std::max(1u, std::thread::hardware_concurrency());
+            graph.clear();
+            transitions.clear();
+            {
+                item_set initial_state = symbol2state(start_symbol);
+                if (initial_state.empty())
+                    throw std::runtime_error("initial state is empty item set");
+                graph.push_back(initial_state);
+            }
+            uint width = get_analysis().columns.size();
+            typename PARSER_IMPL::state_index index;
+            index.insert(graph.back(), 0, graph_lookup(graph));
+            typename types<item_set>::vector successors;
+            typename types<std::thread>::vector workers;
+            for (uint begin = 0; begin < graph.size(); ) {
+                uint end = std::min<uint>(graph.size(), begin + BATCH_SIZE);
+                successors.assign((end - begin) * width, item_set());
+                std::atomic<uint> cursor(0);
+                std::mutex failure_mutex;
+                std::exception_ptr failure;
+                successor_worker worker = {this, &graph, begin, end, &cursor, successors.empty() ? 0 : &successors[0],
+                    &failure_mutex, &failure};
+                uint spawned = std::min<uint>(thread_count, (end - begin + successor_worker::CHUNK_SIZE - 1) / successor_worker::CHUNK_SIZE);
+                workers.clear();
+                //the workers are joined before any exception leaves
+                try {
+                    workers.reserve(spawned);
+                    for (uint i = 1; i < spawned; ++i)
+                        workers.push_back(std::thread(worker));
+                } catch (...) {
+                    worker.fail();
+                }
+                worker();
+                for (uint i = 0; i < workers.size(); ++i)
+                    workers[i].join();
+                if (failure)
+                    std::rethrow_exception(failure);
+                for (uint i = 0; i < successors.size(); ++i) {
+                    item_set& new_state = successors[i];
+                    if (new_state.empty()) {
+                        transitions.push_back(invalid_state);
+                        continue;
+                    }
+                    uint found = index.find(new_state, graph_lookup(graph));
+                    if (found == invalid_state) {
+                        found = graph.size();
+                        graph.push_back(std::move(new_state));
+                        index.insert(graph.back(), found, graph_lookup(graph));
+                    }
+                    transitions.push_back(found);
+                }
+                begin = end;
+            }
+        }
+        item_set_list generate_states(const symbol& start_symbol) const
+        {
+            item_set_list graph;
+            typename types<uint>::vector transitions;
+            generate_states(start_symbol, graph, transitions);
             return graph;
         }
+
+        //dense ACTION/GOTO table over the states of generate_states; one
+        //row per state, one column per symbol
+        struct parse_table
+        {
+            typedef typename parser::uint uint;
+            typedef typename parser::state state;
+            typedef typename parser::symbol symbol;
+            typedef typename parser::rule rule;
+            typedef typename parser::table_action table_action;
+            template <typename T>
+                struct types : parser::template types<T>{};
+            static const uint invalid_state = uint(-1);
+
+            const parser* grammar;
+            uint initial_state;
+            column_map columns;
+            typename types<table_action>::vector actions;
+            typename types<uint>::vector gotos;
+
+            uint column_count() const
+            {
+                return columns.size();
+            }
+            uint state_count() const
+            {
+                return columns.size() == 0 ? 0 : actions.size() / columns.size();
+            }
+            uint get_initial_state() const
+            {
+                return initial_state;
+            }
+            uint get_column(const symbol& s) const
+            {
+                return columns.get_column(s);
+            }
+            table_action get_action(uint state, const symbol& s) const
+            {
+                uint column = get_column(s);
+                if (column == column_count())
+                    return table_action();
+                return actions[state * column_count() + column];
+            }
+            uint get_goto(uint state, const symbol& s) const
+            {
+                uint column = get_column(s);
+                if (column == column_count())
+                    return invalid_state;
+                return gotos[state * column_count() + column];
+            }
+            const rule& get_rule(uint rule_index) const
+            {
+                return grammar->begin_rules()[rule_index];
+            }
+            struct no_callbacks
+            {
+                bool operator()(uint /*rule_index*/) const
+                {
+                    return false;
+                }
+            };
+            uint fold_unit_rules()
+            {
+                return fold_unit_rules(no_callbacks());
+            }
+            //bypasses the states whose only action is reducing a unit rule
+            //A -> B: a shift or goto into one goes straight to where the
+            //goto on A leads from the same state, so a chain of unit
+            //reductions takes no steps at all and the value of B stands for
+            //A. Rules for which keeps_callback(rule_index) is true are left
+            //alone. Errors are found as late as with a default reduction,
+            //before the next shift. Compressed tables and images made from
+            //the table afterwards keep the bypasses. Returns the number of
+            //rewrites.
+            template <typename KEEPS_CALLBACK>
+                uint fold_unit_rules(KEEPS_CALLBACK keeps_callback)
+                {
+                    uint width = column_count();
+                    uint count = state_count();
+                    //for each state, the column of the left hand side it reduces to, or width
+                    typename types<uint>::vector bypassed(count, width);
+                    for (uint i = 0; i < count; ++i) {
+                        uint reduced = invalid_state;
+                        uint column = 0;
+                        for (; column < width; ++column) {
+                            const table_action& cell = actions[i * width + column];
+                            if (cell.get_type() == INVALID_ACTION)
+                                continue;
+                            if (cell.get_type() != REDUCE || (reduced != invalid_state && cell.get_value() != reduced))
+                                break;
+                            reduced = cell.get_value();
+                        }
+                        if (column == width && reduced != invalid_state && get_rule(reduced).size() == 1 && !keeps_callback(reduced))
+                            bypassed[i] = get_column(get_rule(reduced).get_left_hand());
+                    }
+                    //a chain of n unit rules settles in n rounds; cyclic ones never do
+                    uint changed = 0;
+                    for (uint round = 0, changes = 1; changes && round <= uint(grammar->end_rules() - grammar->begin_rules()); ++round) {
+                        changes = 0;
+                        for (uint i = 0; i < count; ++i) {
+                            for (uint column = 0; column < width; ++column) {
+                                uint& next = gotos[i * width + column];
+                                if (next == invalid_state || bypassed[next] == width)
+                                    continue;
+                                uint folded = gotos[i * width + bypassed[next]];
+                                if (folded == invalid_state || folded == next)
+                                    continue;
+                                next = folded;
+                                if (actions[i * width + column].get_type() == SHIFT)
+                                    actions[i * width + column] = table_action::shift(folded);
+                                ++changes;
+                            }
+                        }
+                        changed += changes;
+                    }
+                    return changed;
+                }
+        };
+        template <typename TOKEN_TYPE, typename STACK_TYPES = parse_table, typename STATS = no_stats>
+            struct table_context : basic_context<parse_table, TOKEN_TYPE, STACK_TYPES, STATS>
+        {
+            table_context(const parse_table& table)
+                :basic_context<parse_table, TOKEN_TYPE, STACK_TYPES, STATS>(table, table.get_initial_state())
+            {}
+        };
+
+        //a parse_table packed for cache footprint: symbols are mapped to
+        //dense classes (symbols whose action and goto columns are identical
+        //share a class), states whose only action is one reduction reduce
+        //without looking at the lookahead, and the remaining rows are
+        //overlapped in a row-displacement (comb) array where check[] tells
+        //which state owns an entry
+        struct compressed_table
+        {
+            typedef typename parser::uint uint;
+            typedef typename parser::state state;
+            typedef typename parser::symbol symbol;
+            typedef typename parser::rule rule;
+            typedef typename parser::table_action table_action;
+            template <typename T>
+                struct types : parser::template types<T>{};
+            typedef std::pair<symbol, uint> class_entry;
+            enum { MAX_DIRECT_SYMBOL = 4096 };
+            static const uint invalid_state = uint(-1);
+            static const uint no_class = uint(-1);
+
+            const parser* grammar;
+            uint initial_state;
+            uint class_count;
+            typename types<uint>::vector direct_classes;//indexed by symbol when every symbol is small
+            typename types<class_entry>::vector sorted_classes;//otherwise searched
+            typename types<table_action>::vector default_reductions;//per state, invalid if none
+            typename types<uint>::vector action_base;
+            typename types<table_action>::vector action_entries;
+            typename types<uint>::vector action_check;
+            typename types<uint>::vector goto_base;
+            typename types<uint>::vector goto_entries;
+            typename types<uint>::vector goto_check;
+
+            compressed_table(const parse_table& table)
+                :grammar(table.grammar), initial_state(table.get_initial_state()), class_count(0)
+            {
+                uint width = table.column_count();
+                uint states = table.state_count();
+                typename types<uint>::vector class_of_column(width, no_class);
+                typename types<uint>::vector class_column;//first column of each class
+                for (uint column = 0; column < width; ++column) {
+                    for (uint other = 0; other < class_column.size() && class_of_column[column] == no_class; ++other) {
+                        bool same = true;
+                        for (uint i = 0; i < states && same; ++i)
+                            same = table.actions[i * width + column] == table.actions[i * width + class_column[other]] &&
+                                table.gotos[i * width + column] == table.gotos[i * width + class_column[other]];
+                        if (same)
+                            class_of_column[column] = other;
+                    }
+                    if (class_of_column[column] == no_class) {
+                        class_of_column[column] = class_column.size();
+                        class_column.push_back(column);
+                    }
+                }
+                class_count = class_column.size();
+
+                symbol max_symbol = 0;
+                for (uint column = 0; column < width; ++column)
+                    max_symbol = std::max(max_symbol, table.columns[column]);
+                if (max_symbol < MAX_DIRECT_SYMBOL) {
+                    direct_classes.assign(max_symbol + 1, no_class);
+                    for (uint column = width; column-- > 0; )
+                        direct_classes[table.columns[column]] = class_of_column[column];
+                } else {
+                    for (uint column = 0; column < width; ++column)
+                        if (table.get_column(table.columns[column]) == column)
+                            sorted_classes.push_back(class_entry(table.columns[column], class_of_column[column]));
+                    std::sort(sorted_classes.begin(), sorted_classes.end());
+                }
+
+                typename types<table_action>::vector actions(states * class_count);
+                typename types<uint>::vector gotos(states * class_count);
+                for (uint i = 0; i < states; ++i) {
+                    for (uint c = 0; c < class_count; ++c) {
+                        actions[i * class_count + c] = table.actions[i * width + class_column[c]];
+                        gotos[i * class_count + c] = table.gotos[i * width + class_column[c]];
+                    }
+                }
+                default_reductions.assign(states, table_action());
+                for (uint i = 0; i < states; ++i) {
+                    table_action only;
+                    bool single = true;
+                    for (uint c = 0; c < class_count && single; ++c) {
+                        table_action current = actions[i * class_count + c];
+                        if (current.get_type() == INVALID_ACTION)
+                            continue;
+                        if (current.get_type() != REDUCE || (only.get_type() != INVALID_ACTION && only != current))
+                            single = false;
+                        only = current;
+                    }
+                    if (single && only.get_type() == REDUCE) {
+                        default_reductions[i] = only;
+                        for (uint c = 0; c < class_count; ++c)
+                            actions[i * class_count + c] = table_action();
+                    }
+                }
+                pack(actions, table_action(), action_base, action_entries, action_check);
+                pack(gotos, uint(invalid_state), goto_base, goto_entries, goto_check);
+            }
+
+            //first-fit row displacement, densest rows first
+            template <typename VECTOR, typename T>
+                void pack(const VECTOR& rows, const T& empty, typename types<uint>::vector& base,
+                        VECTOR& entries, typename types<uint>::vector& check)
+                {
+                    uint states = class_count ? rows.size() / class_count : 0;
+                    typename types<std::pair<uint, uint> >::vector order;//(-used, state)
+                    for (uint i = 0; i < states; ++i) {
+                        uint used = 0;
+                        for (uint c = 0; c < class_count; ++c)
+                            used += !(rows[i * class_count + c] == empty);
+                        order.push_back(std::make_pair(class_count - used, i));
+                    }
+                    std::sort(order.begin(), order.end());
+                    base.assign(states, 0);
+                    entries.clear();
+                    check.clear();
+                    typename types<uint>::vector used_columns;
+                    for (uint k = 0; k < order.size(); ++k) {
+                        uint i = order[k].second;
+                        used_columns.clear();
+                        for (uint c = 0; c < class_count; ++c)
+                            if (!(rows[i * class_count + c] == empty))
+                                used_columns.push_back(c);
+                        if (used_columns.empty())
+                            continue;
+                        uint offset = 0;
+                        for (;; ++offset) {
+                            bool fits = true;
+                            for (uint j = 0; j < used_columns.size() && fits; ++j)
+                                fits = offset + used_columns[j] >= check.size() || check[offset + used_columns[j]] == invalid_state;
+                            if (fits)
+                                break;
+                        }
+                        base[i] = offset;
+                        if (offset + class_count > check.size()) {
+                            check.resize(offset + class_count, invalid_state);
+                            entries.resize(offset + class_count, empty);
+                        }
+                        for (uint j = 0; j < used_columns.size(); ++j) {
+                            check[offset + used_columns[j]] = i;
+                            entries[offset + used_columns[j]] = rows[i * class_count + used_columns[j]];
+                        }
+                    }
+                }
+
+            uint state_count() const
+            {
+                return default_reductions.size();
+            }
+            uint get_initial_state() const
+            {
+                return initial_state;
+            }
+            //returns no_class for symbols outside of the grammar
+            uint get_class(const symbol& s) const
+            {
+                if (!direct_classes.empty() || sorted_classes.empty())
+                    return s < direct_classes.size() ? direct_classes[s] : no_class;
+                typename types<class_entry>::vector::const_iterator found =
+                    std::lower_bound(sorted_classes.begin(), sorted_classes.end(), class_entry(s, 0));
+                if (found == sorted_classes.end() || found->first != s)
+                    return no_class;
+                return found->second;
+            }
+            bool has_default_reduction(uint state) const
+            {
+                return default_reductions[state].get_type() == REDUCE;
+            }
+            table_action get_action(uint state, const symbol& s) const
+            {
+                if (has_default_reduction(state))
+                    return default_reductions[state];
+                uint symbol_class = get_class(s);
+                if (symbol_class == no_class)
+                    return table_action();
+                uint i = action_base[state] + symbol_class;
+                return i < action_check.size() && action_check[i] == state ? action_entries[i] : table_action();
+            }
+            uint get_goto(uint state, const symbol& s) const
+            {
+                uint symbol_class = get_class(s);
+                if (symbol_class == no_class)
+                    return invalid_state;
+                uint i = goto_base[state] + symbol_class;
+                return i < goto_check.size() && goto_check[i] == state ? goto_entries[i] : invalid_state;
+            }
+            const rule& get_rule(uint rule_index) const
+            {
+                return grammar->begin_rules()[rule_index];
+            }
+            //bytes taken by the lookup structures
+            uint size_in_bytes() const
+            {
+                return sizeof(uint) * (direct_classes.size() + action_base.size() + action_check.size() +
+                        goto_base.size() + goto_entries.size() + goto_check.size()) +
+                    sizeof(class_entry) * sorted_classes.size() +
+                    sizeof(table_action) * (default_reductions.size() + action_entries.size());
+            }
+        };
+        template <typename TOKEN_TYPE, typename STACK_TYPES = compressed_table, typename STATS = no_stats>
+            struct compressed_context : basic_context<compressed_table, TOKEN_TYPE, STACK_TYPES, STATS>
+        {
+            compressed_context(const compressed_table& table)
+                :basic_context<compressed_table, TOKEN_TYPE, STACK_TYPES, STATS>(table, table.get_initial_state())
+            {}
+        };
+
+        //precedence and associativity are resolved here, so conflicts are
+        //reported while compiling instead of while parsing. The states are
+        //built on thread_count threads (see generate_states_parallel).
+        parse_table compile(const symbol& start_symbol, uint thread_count = 1) const
+        {
+            parse_table table;
+            table.grammar = this;
+            table.initial_state = 0;
+            table.columns = get_analysis().columns;
+
+            item_set_list graph;
+            generate_states(start_symbol, graph, table.gotos, thread_count);
+            table.actions.reserve(table.gotos.size());
+            for (uint i = 0; i < graph.size(); ++i) {
+                for (uint j = 0; j < table.columns.size(); ++j) {
+                    action needed_action = graph[i].get_action(table.columns[j]);
+                    switch (needed_action.get_type()) {
+                        case INVALID_ACTION:
+                            table.actions.push_back(table_action());
+                            break;
+                        case SHIFT:
+                            table.actions.push_back(table_action::shift(table.gotos[i * table.columns.size() + j]));
+                            break;
+                        case REDUCE:
+                            table.actions.push_back(table_action::reduce(needed_action.get_rule_index()));
+                            break;
+                    }
+                }
+            }
+            return table;
+        }
+
+        static bool test_bit(const uint* set, uint bit)
+        {
+            return (set[bit / 32] >> (bit % 32)) & 1;
+        }
+        static void set_bit(uint* set, uint bit)
+        {
+            set[bit / 32] |= 1u << (bit % 32);
+        }
+        //returns whether to changed
+        static bool merge_set(uint* to, const uint* from, uint words)
+        {
+            bool changed = false;
+            for (uint i = 0; i < words; ++i) {
+                uint merged = to[i] | from[i];
+                if (merged != to[i]) {
+                    to[i] = merged;
+                    changed = true;
+                }
+            }
+            return changed;
+        }
+
+        //FIRST, nullable and FOLLOW for every column of the grammar
+        //analysis; the sets are bitsets over columns with one spare bit
+        //past the last column, which the LALR construction uses as a marker
+        struct lookahead_sets
+        {
+            uint words_per_set;
+            typename types<char>::vector nullable;
+            typename types<uint>::vector first;
+            typename types<uint>::vector follow;
+
+            const uint* get_first(uint column) const
+            {
+                return &first[column * words_per_set];
+            }
+            const uint* get_follow(uint column) const
+            {
+                return &follow[column * words_per_set];
+            }
+        };
+        lookahead_sets compute_lookahead_sets() const
+        {
+            const grammar_analysis& grammar = get_analysis();
+            const column_map& columns = grammar.columns;
+            uint width = columns.size();
+            lookahead_sets rez;
+            uint words = rez.words_per_set = (width + 32) / 32;
+            rez.nullable.assign(width, 0);
+            rez.first.assign(width * words, 0);
+            rez.follow.assign(width * words, 0);
+            for (uint column = 0; column < width; ++column)
+                if (!grammar.has_rules(column))
+                    set_bit(&rez.first[column * words], column);
+
+            for (bool changed = true; changed; ) {
+                changed = false;
+                for (rule_iterator rule_element = begin_rules(); rule_element != end_rules(); ++rule_element) {
+                    uint left = columns.get_column(rule_element->get_left_hand());
+                    bool all_nullable = true;
+                    for (uint i = 0; i < rule_element->size(); ++i) {
+                        uint column = columns.get_column((*rule_element)[i]);
+                        changed |= merge_set(&rez.first[left * words], rez.get_first(column), words);
+                        if (!rez.nullable[column]) {
+                            all_nullable = false;
+                            break;
+                        }
+                    }
+                    if (all_nullable && !rez.nullable[left]) {
+                        rez.nullable[left] = 1;
+                        changed = true;
+                    }
+                }
+            }
+            for (bool changed = true; changed; ) {
+                changed = false;
+                for (rule_iterator rule_element = begin_rules(); rule_element != end_rules(); ++rule_element) {
+                    uint left = columns.get_column(rule_element->get_left_hand());
+                    for (uint i = 0; i < rule_element->size(); ++i) {
+                        uint column = columns.get_column((*rule_element)[i]);
+                        if (!grammar.has_rules(column))
+                            continue;
+                        bool rest_nullable = true;
+                        for (uint j = i + 1; j < rule_element->size(); ++j) {
+                            uint next_column = columns.get_column((*rule_element)[j]);
+                            changed |= merge_set(&rez.follow[column * words], rez.get_first(next_column), words);
+                            if (!rez.nullable[next_column]) {
+                                rest_nullable = false;
+                                break;
+                            }
+                        }
+                        if (rest_nullable)
+                            changed |= merge_set(&rez.follow[column * words], rez.get_follow(left), words);
+                    }
+                }
+            }
+            return rez;
+        }
+
+        //the LR(0) states of generate_states with LALR(1) lookaheads for
+        //their kernel items
+        struct lalr_states
+        {
+            item_set_list states;
+            typename types<uint>::vector transitions;
+            lookahead_sets sets;
+            typename types<uint>::vector kernel_begin;//state -> first index into kernel_items
+            typename types<item>::vector kernel_items;
+            typename types<uint>::vector lookaheads;//kernel item -> sets.words_per_set words
+
+            uint find_kernel_item(uint state, const item& kernel_item) const
+            {
+                return std::lower_bound(kernel_items.begin() + kernel_begin[state],
+                        kernel_items.begin() + kernel_begin[state + 1], kernel_item) - kernel_items.begin();
+            }
+            uint* get_lookaheads(uint kernel_index)
+            {
+                return &lookaheads[kernel_index * sets.words_per_set];
+            }
+            const uint* get_lookaheads(uint kernel_index) const
+            {
+                return &lookaheads[kernel_index * sets.words_per_set];
+            }
+        };
+        //scratch space for spreading lookaheads from items to the initial
+        //items their closure adds; initial holds a set per rule and touched
+        //lists the rules whose set is not empty
+        struct lookahead_closure
+        {
+            typename types<uint>::vector initial;
+            typename types<char>::vector reached;
+            typename types<char>::vector queued;
+            typename types<uint>::vector touched;
+            typename types<uint>::vector pending;
+            typename types<uint>::vector scratch;
+
+            lookahead_closure(uint rule_count, uint words)
+                :initial(rule_count * words, 0), reached(rule_count, 0), queued(rule_count, 0), scratch(words, 0)
+            {}
+            const uint* get_initial(uint rule_index) const
+            {
+                return &initial[rule_index * scratch.size()];
+            }
+            void reset()
+            {
+                for (uint i = 0; i < touched.size(); ++i) {
+                    std::fill(initial.begin() + touched[i] * scratch.size(),
+                            initial.begin() + (touched[i] + 1) * scratch.size(), 0);
+                    reached[touched[i]] = 0;
+                }
+                touched.clear();
+            }
+        };
+        void spread_lookaheads(const lookahead_sets& sets, const item& from, const uint* from_lookaheads, lookahead_closure& closure_state) const
+        {
+            const grammar_analysis& grammar = get_analysis();
+            const rule& on_rule = from.get_rule();
+            uint dot = from.get_dot_position();
+            if (dot == on_rule.size())
+                return;
+            uint next_column = grammar.columns.get_column(on_rule[dot]);
+            if (!grammar.has_rules(next_column))
+                return;
+            uint words = sets.words_per_set;
+            typename types<uint>::vector& spread = closure_state.scratch;
+            std::fill(spread.begin(), spread.end(), 0);
+            bool rest_nullable = true;
+            for (uint i = dot + 1; i < on_rule.size(); ++i) {
+                uint column = grammar.columns.get_column(on_rule[i]);
+                merge_set(&spread[0], sets.get_first(column), words);
+                if (!sets.nullable[column]) {
+                    rest_nullable = false;
+                    break;
+                }
+            }
+            if (rest_nullable)
+                merge_set(&spread[0], from_lookaheads, words);
+            for (uint i = grammar.left_hand_begin[next_column]; i < grammar.left_hand_begin[next_column + 1]; ++i) {
+                uint rule_index = grammar.rules_by_left_hand[i];
+                if (!merge_set(&closure_state.initial[rule_index * words], &spread[0], words))
+                    continue;
+                if (!closure_state.reached[rule_index]) {
+                    closure_state.reached[rule_index] = 1;
+                    closure_state.touched.push_back(rule_index);
+                }
+                if (!closure_state.queued[rule_index]) {
+                    closure_state.queued[rule_index] = 1;
+                    closure_state.pending.push_back(rule_index);
+                }
+            }
+        }
+        void close_lookaheads(const lookahead_sets& sets, lookahead_closure& closure_state) const
+        {
+            while (!closure_state.pending.empty()) {
+                uint rule_index = closure_state.pending.back();
+                closure_state.pending.pop_back();
+                closure_state.queued[rule_index] = 0;
+                spread_lookaheads(sets, item(rule_index, begin_rules()[rule_index]),
+                        closure_state.get_initial(rule_index), closure_state);
+            }
+        }
+        //kernel item of the successor of state that moved comes from
+        uint successor_kernel_item(const lalr_states& lalr, uint state, const item& moved) const
+        {
+            const column_map& columns = get_analysis().columns;
+            uint column = columns.get_column(moved.get_rule()[moved.get_dot_position() - 1]);
+            return lalr.find_kernel_item(lalr.transitions[state * columns.size() + column], moved);
+        }
+        //determines the lookaheads of every kernel item by spontaneous
+        //generation and propagation; the bit of the column after the last
+        //stands for the end of the input
+        void build_lalr(const symbol& start_symbol, lalr_states& rez, uint thread_count = 1) const
+        {
+            generate_states(start_symbol, rez.states, rez.transitions, thread_count);
+            rez.sets = compute_lookahead_sets();
+            uint words = rez.sets.words_per_set;
+            uint marker = get_analysis().columns.size();
+            uint rule_count = end_rules() - begin_rules();
+
+            rez.kernel_begin.clear();
+            rez.kernel_items.clear();
+            for (uint i = 0; i < rez.states.size(); ++i) {
+                rez.kernel_begin.push_back(rez.kernel_items.size());
+                for (typename item_set::const_iterator it = rez.states[i].begin(); it != rez.states[i].end(); ++it)
+                    if (it->get_dot_position() > 0 || (i == 0 && it->get_left_hand() == start_symbol))
+                        rez.kernel_items.push_back(*it);
+            }
+            rez.kernel_begin.push_back(rez.kernel_items.size());
+            rez.lookaheads.assign(rez.kernel_items.size() * words, 0);
+            //the start items look ahead to the end of the input, which is
+            //the marker column once the propagation is done
+            for (uint k = rez.kernel_begin[0]; k < rez.kernel_begin[1]; ++k)
+                if (rez.kernel_items[k].get_dot_position() == 0)
+                    set_bit(rez.get_lookaheads(k), marker);
+
+            typename types<std::pair<uint, uint> >::vector links;
+            {
+                lookahead_closure closure_state(rule_count, words);
+                typename types<uint>::vector marker_set(words, 0);
+                set_bit(&marker_set[0], marker);
+                for (uint i = 0; i < rez.states.size(); ++i) {
+                    for (uint k = rez.kernel_begin[i]; k < rez.kernel_begin[i + 1]; ++k) {
+                        const item& kernel_item = rez.kernel_items[k];
+                        if (!kernel_item.at_end())
+                            links.push_back(std::make_pair(k, successor_kernel_item(rez, i, kernel_item.next())));
+                        spread_lookaheads(rez.sets, kernel_item, &marker_set[0], closure_state);
+                        close_lookaheads(rez.sets, closure_state);
+                        for (uint j = 0; j < closure_state.touched.size(); ++j) {
+                            uint rule_index = closure_state.touched[j];
+                            const rule& on_rule = begin_rules()[rule_index];
+                            if (on_rule.empty())
+                                continue;
+                            const uint* spontaneous = closure_state.get_initial(rule_index);
+                            uint target = successor_kernel_item(rez, i, item(rule_index, on_rule).next());
+                            uint* target_lookaheads = rez.get_lookaheads(target);
+                            merge_set(target_lookaheads, spontaneous, words);
+                            if (test_bit(spontaneous, marker)) {
+                                target_lookaheads[marker / 32] &= ~(1u << (marker % 32));
+                                links.push_back(std::make_pair(k, target));
+                            }
+                        }
+                        closure_state.reset();
+                    }
+                }
+            }
+            std::sort(links.begin(), links.end());
+            links.erase(std::unique(links.begin(), links.end()), links.end());
+            typename types<uint>::vector link_begin(rez.kernel_items.size() + 1, 0);
+            for (uint i = 0; i < links.size(); ++i)
+                ++link_begin[links[i].first + 1];
+            for (uint i = 0; i < rez.kernel_items.size(); ++i)
+                link_begin[i + 1] += link_begin[i];
+
+            typename types<uint>::vector pending;
+            typename types<char>::vector queued(rez.kernel_items.size(), 1);
+            for (uint i = 0; i < rez.kernel_items.size(); ++i)
+                pending.push_back(i);
+            while (!pending.empty()) {
+                uint from = pending.back();
+                pending.pop_back();
+                queued[from] = 0;
+                for (uint i = link_begin[from]; i < link_begin[from + 1]; ++i) {
+                    uint to = links[i].second;
+                    if (merge_set(rez.get_lookaheads(to), rez.get_lookaheads(from), words) && !queued[to]) {
+                        queued[to] = 1;
+                        pending.push_back(to);
+                    }
+                }
+            }
+        }
+
+        struct conflict
+        {
+            uint state;
+            symbol lookahead;
+            const char* message;
+            table_action chosen;
+        };
+        typedef typename types<conflict>::vector conflict_list;
+
+        //feeds every LALR(1) action of a state to the callback of its
+        //column in cells, which has one more callback, at column count, for
+        //the end of the input
+        template <typename CELLS>
+            void feed_lalr_actions(const lalr_states& lalr, uint state, CELLS& cells, lookahead_closure& closure_state) const
+        {
+            const column_map& columns = get_analysis().columns;
+            uint width = columns.size();
+            for (typename item_set::const_iterator it = lalr.states[state].begin(); it != lalr.states[state].end(); ++it)
+                if (!it->at_end())
+                    cells[columns.get_column(it->next_symbol())](action::shift(*it));
+            for (uint k = lalr.kernel_begin[state]; k < lalr.kernel_begin[state + 1]; ++k) {
+                const item& kernel_item = lalr.kernel_items[k];
+                if (kernel_item.at_end()) {
+                    for (uint column = 0; column <= width; ++column)
+                        if (test_bit(lalr.get_lookaheads(k), column))
+                            cells[column](action::reduce(kernel_item));
+                }
+                spread_lookaheads(lalr.sets, kernel_item, lalr.get_lookaheads(k), closure_state);
+            }
+            close_lookaheads(lalr.sets, closure_state);
+            for (uint j = 0; j < closure_state.touched.size(); ++j) {
+                uint rule_index = closure_state.touched[j];
+                if (!begin_rules()[rule_index].empty())
+                    continue;
+                for (uint column = 0; column <= width; ++column)
+                    if (test_bit(closure_state.get_initial(rule_index), column))
+                        cells[column](action::reduce(item(rule_index, begin_rules()[rule_index])));
+            }
+            closure_state.reset();
+        }
+        //LALR(1) table over the same states as compile: reductions only
+        //happen on their lookaheads, and conflicts precedence cannot settle
+        //are appended to conflicts (and settled the yacc way) instead of
+        //being thrown
+        parse_table compile_lalr(const symbol& start_symbol, conflict_list& conflicts, uint thread_count = 1) const
+        {
+            typedef typename item_set::get_action_callback get_action_callback;
+            lalr_states lalr;
+            build_lalr(start_symbol, lalr, thread_count);
+            const column_map& columns = get_analysis().columns;
+            uint width = columns.size();
+            uint words = lalr.sets.words_per_set;
+
+            parse_table table;
+            table.grammar = this;
+            table.initial_state = 0;
+            table.columns = columns;
+            table.gotos = lalr.transitions;
+            table.actions.reserve(table.gotos.size());
+
+            lookahead_closure closure_state(end_rules() - begin_rules(), words);
+            typename types<get_action_callback>::vector callbacks;
+            for (uint i = 0; i < lalr.states.size(); ++i) {
+                callbacks.assign(width + 1, get_action_callback(false));
+                feed_lalr_actions(lalr, i, callbacks, closure_state);
+                for (uint column = 0; column < width; ++column) {
+                    const action& needed_action = callbacks[column].result;
+                    table_action chosen;
+                    switch (needed_action.get_type()) {
+                        case SHIFT:
+                            chosen = table_action::shift(table.gotos[i * width + column]);
+                            break;
+                        case REDUCE:
+                            chosen = table_action::reduce(needed_action.get_rule_index());
+                            break;
+                    }
+                    table.actions.push_back(chosen);
+                    if (callbacks[column].conflict) {
+                        conflict found = {i, columns[column], callbacks[column].conflict, chosen};
+                        conflicts.push_back(found);
+                    }
+                }
+            }
+            return table;
+        }
+
+        mutable grammar_analysis analysis;
+        mutable state_cache cache;
     };
+    template <typename PARSER_IMPL>
+        const typename parser<PARSER_IMPL>::uint parser<PARSER_IMPL>::invalid_state;
+    template <typename PARSER_IMPL>
+        const typename parser<PARSER_IMPL>::uint parser<PARSER_IMPL>::parse_table::invalid_state;
+    template <typename PARSER_IMPL>
+        const typename parser<PARSER_IMPL>::uint parser<PARSER_IMPL>::compressed_table::invalid_state;
+    template <typename PARSER_IMPL>
+        const typename parser<PARSER_IMPL>::uint parser<PARSER_IMPL>::compressed_table::no_class;
+    template <typename PARSER_IMPL>
+        const typename parser<PARSER_IMPL>::uint parser<PARSER_IMPL>::state_cache::unknown_action;
+    template <typename PARSER_IMPL>
+        const typename parser<PARSER_IMPL>::uint parser<PARSER_IMPL>::state_cache::unknown_state;
+    template <typename PARSER_IMPL, typename STATS>
+        inline typename parser<PARSER_IMPL>::table_action lookup_action(const parser<PARSER_IMPL>& automaton,
+                typename parser<PARSER_IMPL>::state state, const typename parser<PARSER_IMPL>::symbol& s, STATS& stats)
+        {
+            return automaton.get_action(state, s, stats);
+        }
+    template <typename PARSER_IMPL, typename STATS>
+        inline typename parser<PARSER_IMPL>::state lookup_goto(const parser<PARSER_IMPL>& automaton,
+                typename parser<PARSER_IMPL>::state state, const typename parser<PARSER_IMPL>::symbol& s, STATS& stats)
+        {
+            return automaton.get_goto(state, s, stats);
+        }
     typedef parser<default_parser_impl> default_parser;
 }
 